@@ -0,0 +1,500 @@
+// Microbenchmarks: runs generated kernels for a fixed number of instructions with the JIT and the interpreter and reports
+// host time per DSP instruction plus JIT compile time per block. Alternatively, compiles a whole program with the JIT and reports compile statistics
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "../disassemble/commandline.h"
+
+#include "dsp56kEmu/dsp.h"
+#include "dsp56kEmu/jit.h"
+#include "dsp56kEmu/memory.h"
+#include "dsp56kEmu/peripherals.h"
+#include "dsp56kEmu/programanalysis.h"
+
+using namespace dsp56k;
+
+namespace
+{
+	constexpr TWord g_memSize		= 0x40000;
+	constexpr TWord g_dataSize		= 0x400;	// size of the area at the start of X and Y that is initialized with random data
+	constexpr TWord g_programStart	= 0x100;
+
+	DefaultMemoryValidator g_memoryMap;
+
+	// Minimal assembler, opcodes are encoded by the caller
+	class Program
+	{
+	public:
+		TWord pc() const { return g_programStart + static_cast<TWord>(m_code.size()); }
+
+		TWord op(const TWord _opA)
+		{
+			const auto pc = this->pc();
+			m_code.push_back(_opA);
+			return pc;
+		}
+
+		TWord op(const TWord _opA, const TWord _opB)
+		{
+			const auto pc = op(_opA);
+			m_code.push_back(_opB);
+			return pc;
+		}
+
+		// do #_count,<label>. Returns the address of the extension word that needs to be patched via endDo
+		TWord doLoop(const TWord _count)
+		{
+			return op(0x060080 | ((_count & 0xff) << 8) | ((_count >> 8) & 0xf), 0) + 1;
+		}
+
+		// sets the loop address of a previous doLoop to the last instruction that has been added
+		void endDo(const TWord _doExtensionWord)
+		{
+			patch(_doExtensionWord, pc() - 1);
+		}
+
+		void patch(const TWord _addr, const TWord _value)
+		{
+			m_code[_addr - g_programStart] = _value;
+		}
+
+		void moveImmediate(const TWord _opA, const TWord _value)	{ op(_opA, _value); }
+		void jmp(const TWord _addr)									{ op(0x0c0000 | _addr); }
+		void rep(const TWord _count)								{ op(0x0600a0 | ((_count & 0xff) << 8) | ((_count >> 8) & 0xf)); }
+
+		const std::vector<TWord>& code() const { return m_code; }
+
+	private:
+		std::vector<TWord> m_code;
+	};
+
+	// opcodes used by the kernels
+	enum : TWord
+	{
+		OpNop			= 0x000000,
+		OpMoveX0		= 0x44f400,		// move #>xxxx,x0
+		OpMoveY0		= 0x46f400,		// move #>xxxx,y0
+		OpMoveA			= 0x56f400,		// move #>xxxx,a
+		OpMoveR0		= 0x60f400,		// move #>xxxx,r0
+		OpMoveR1		= 0x61f400,		// move #>xxxx,r1
+		OpMoveR4		= 0x64f400,		// move #>xxxx,r4
+		OpMoveM0		= 0x0500a0,		// move #xx,m0, 8 bit immediate in bits 8-15
+		OpMoveM1		= 0x0500a1,
+		OpMoveM4		= 0x0500a4,
+		OpClrA			= 0x200013,
+		OpAddX0A		= 0x200040,
+		OpAddY0A		= 0x200050,
+		OpCmpY0A		= 0x200055,
+		OpTstA			= 0x200003,
+		OpMacA			= 0x2000d2,		// mac y0,x0,a
+		OpMacB			= 0x2000da,		// mac y0,x0,b
+		OpMacrA			= 0x2000d3,		// macr y0,x0,a
+		OpClrAXY		= 0xf09813,		// clr a x:(r0)+,x0 y:(r4)+,y0
+		OpMacAXY		= 0xf098d2,		// mac y0,x0,a x:(r0)+,x0 y:(r4)+,y0
+		OpMoveXR0A		= 0x56d800,		// move x:(r0)+,a
+		OpMoveAXR1		= 0x565900,		// move a,x:(r1)+
+		OpDivX0A		= 0x018040,		// div x0,a
+		OpAndiCCR		= 0x0000b9,		// andi #xx,ccr, 8 bit immediate in bits 8-15
+		OpJlt			= 0x0e9000,		// jlt xxx, 12 bit address
+		OpJne			= 0x0e2000,		// jne xxx, 12 bit address
+		OpJclrHsr0		= 0x0a8380,		// jclr #0,x:<<$ffffc3,xxxx (HDI08 HSR, receive data full)
+	};
+
+	struct Kernel
+	{
+		const char* name;
+		const char* description;
+		void (*build)(Program&);
+	};
+
+	void buildMac(Program& _p)
+	{
+		_p.moveImmediate(OpMoveX0, 0x123456);
+		_p.moveImmediate(OpMoveY0, 0x012345);
+		_p.op(OpClrA);
+
+		const auto loop = _p.pc();
+		const auto la = _p.doLoop(1000);
+		for(size_t i=0; i<8; ++i)
+		{
+			_p.op(OpMacA);
+			_p.op(OpMacB);
+		}
+		_p.endDo(la);
+		_p.jmp(loop);
+	}
+
+	void buildFir(Program& _p)
+	{
+		// 32 tap FIR, coefficients in Y, delay line in X, both modulo addressed
+		_p.moveImmediate(OpMoveR0, 0);
+		_p.moveImmediate(OpMoveR1, 0x200);
+		_p.moveImmediate(OpMoveR4, 0);
+		_p.op(OpMoveM0 | (31 << 8));
+		_p.op(OpMoveM1 | (0xff << 8));
+		_p.op(OpMoveM4 | (31 << 8));
+
+		const auto loop = _p.pc();
+		_p.op(OpClrAXY);
+		_p.rep(31);
+		_p.op(OpMacAXY);
+		_p.op(OpMacrA);
+		_p.op(OpMoveAXR1);
+		_p.jmp(loop);
+	}
+
+	void buildDiv(Program& _p)
+	{
+		_p.moveImmediate(OpMoveX0, 0x400000);
+
+		const auto loop = _p.pc();
+		_p.moveImmediate(OpMoveA, 0x123456);
+		_p.op(OpAndiCCR | (0xfe << 8));		// clear carry
+		_p.rep(24);
+		_p.op(OpDivX0A);
+		_p.jmp(loop);
+	}
+
+	void buildBranch(Program& _p)
+	{
+		_p.moveImmediate(OpMoveX0, 0x001000);
+		_p.moveImmediate(OpMoveY0, 0x00c000);
+		_p.op(OpClrA);
+
+		const auto loop = _p.pc();
+		const auto la = _p.doLoop(1000);
+		_p.op(OpAddX0A);
+		_p.op(OpCmpY0A);
+		const auto jlt = _p.op(OpJlt);
+		_p.op(OpClrA);
+		const auto skipClr = _p.op(OpTstA);
+		const auto jne = _p.op(OpJne);
+		_p.op(OpAddY0A);
+		const auto skipAdd = _p.op(OpNop);
+		_p.patch(jlt, OpJlt | skipClr);
+		_p.patch(jne, OpJne | skipAdd);
+		_p.endDo(la);
+		_p.jmp(loop);
+	}
+
+	void buildDelayLine(Program& _p)
+	{
+		// 256 word delay line, read and write pointers are modulo addressed
+		_p.moveImmediate(OpMoveR0, 0);
+		_p.moveImmediate(OpMoveR1, 0x80);
+		_p.op(OpMoveM0 | (0xff << 8));
+		_p.op(OpMoveM1 | (0xff << 8));
+		_p.moveImmediate(OpMoveX0, 0x000100);
+
+		const auto loop = _p.pc();
+		const auto la = _p.doLoop(1000);
+		_p.op(OpMoveXR0A);
+		_p.op(OpAddX0A);
+		_p.op(OpMoveAXR1);
+		_p.endDo(la);
+		_p.jmp(loop);
+	}
+
+	void buildPoll(Program& _p)
+	{
+		// waits for host data that never arrives
+		const auto loop = _p.pc();
+		_p.op(OpJclrHsr0, loop);
+	}
+
+	const Kernel g_kernels[] =
+	{
+		{"mac",			"MAC loop without memory accesses",							&buildMac},
+		{"fir",			"FIR filter, REP MAC with parallel X/Y moves",				&buildFir},
+		{"div",			"REP 24 DIV",												&buildDiv},
+		{"branch",		"conditional jumps in a DO loop",							&buildBranch},
+		{"delayline",	"modulo addressed delay line",								&buildDelayLine},
+		{"poll",		"polling of a peripheral status bit",						&buildPoll},
+	};
+
+	struct Instance
+	{
+		explicit Instance(const bool _interpreterOnly) : mem(g_memoryMap, g_memSize), dsp(mem, &peripherals, &peripherals)
+		{
+			dsp.setInterpreterOnly(_interpreterOnly);
+		}
+
+		Peripherals56362 peripherals;
+		Memory mem;
+		DSP dsp;
+	};
+
+	struct Result
+	{
+		std::string kernel;
+		std::string engine;
+		uint64_t instructions = 0;
+		double nsPerInstruction = 0.0;
+		uint64_t jitBlocks = 0;
+		double jitCompileNsPerBlock = 0.0;
+	};
+
+	// instructions skipped in idle loops advance the instruction counter but are not executed, they are not counted
+	uint64_t run(DSP& _dsp, const uint64_t _instructions)
+	{
+		const auto& telemetry = _dsp.getTelemetry();
+
+		uint64_t executed = 0;
+
+		while(executed < _instructions)
+		{
+			const auto counter = _dsp.getInstructionCounter();
+			const auto idle = telemetry.get(TelemetryCounter::IdleInstructions);
+
+			_dsp.exec(static_cast<uint32_t>(std::min<uint64_t>(_instructions - executed, 4096)));
+
+			executed += static_cast<uint32_t>(_dsp.getInstructionCounter() - counter);
+			executed -= telemetry.get(TelemetryCounter::IdleInstructions) - idle;
+		}
+
+		return executed;
+	}
+
+	Result benchmark(const Kernel& _kernel, const bool _interpreter, const uint64_t _instructions, const uint32_t _runs)
+	{
+		Program program;
+		_kernel.build(program);
+
+		std::mt19937 rand(1);
+		std::vector<TWord> data(g_dataSize);
+
+		std::unique_ptr<Instance> instance(new Instance(_interpreter));
+
+		auto& mem = instance->mem;
+		auto& dsp = instance->dsp;
+
+		for(auto area : {MemArea_X, MemArea_Y})
+		{
+			for(auto& d : data)
+				d = rand() & 0xffffff;
+			mem.restore(area, 0, data.data(), g_dataSize);
+		}
+
+		mem.restore(MemArea_P, g_programStart, program.code().data(), static_cast<TWord>(program.code().size()));
+
+		dsp.setPC(g_programStart);
+
+		// warm up, compiles all JIT blocks of the kernel
+		run(dsp, std::max<uint64_t>(_instructions / 10, 1));
+
+		Result r;
+		r.kernel = _kernel.name;
+		r.engine = _interpreter ? "interpreter" : "jit";
+		r.nsPerInstruction = std::numeric_limits<double>::max();
+
+		for(uint32_t i=0; i<_runs; ++i)
+		{
+			const auto t0 = std::chrono::high_resolution_clock::now();
+			const auto executed = run(dsp, _instructions);
+			const auto t1 = std::chrono::high_resolution_clock::now();
+
+			const auto ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+
+			r.instructions = executed;
+			r.nsPerInstruction = std::min(r.nsPerInstruction, ns / static_cast<double>(executed));
+		}
+
+		const auto& telemetry = dsp.getTelemetry();
+		r.jitBlocks = telemetry.get(TelemetryCounter::JitBlocksCompiled);
+
+		if(r.jitBlocks)
+			r.jitCompileNsPerBlock = static_cast<double>(telemetry.get(TelemetryCounter::JitCompileTimeNs)) / static_cast<double>(r.jitBlocks);
+
+		return r;
+	}
+
+	// Compiles all code of a program that is statically reachable from the reset and interrupt vectors, without executing it
+	int compileProgram(const std::string& _filename, const bool _json)
+	{
+		std::unique_ptr<Instance> instance(new Instance(false));
+
+		auto& mem = instance->mem;
+		auto& dsp = instance->dsp;
+		auto& jit = dsp.getJit();
+
+		// compile explicitly below to measure it
+		dsp.setPrecompileOnLoad(false);
+
+		if(!mem.loadOMF(_filename))
+		{
+			std::cout << "Failed to load " << _filename << std::endl;
+			return -1;
+		}
+
+		jit.resetCompileStats();
+
+		// the analysis does not need the JIT lock, measure it separately from compiling
+		const auto t0 = std::chrono::high_resolution_clock::now();
+
+		const auto analysis = dsp.analyzeProgram();
+
+		const auto t1 = std::chrono::high_resolution_clock::now();
+
+		dsp.precompile(analysis);
+
+		const auto t2 = std::chrono::high_resolution_clock::now();
+		const auto analysisNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+		const auto wallNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count());
+
+		const auto& st = jit.getCompileStats();
+
+		const auto blocks = static_cast<double>(std::max<uint64_t>(st.blocks, 1));
+		const auto blocksPerSecond = wallNs > 0 ? static_cast<double>(st.blocks) * 1e9 / wallNs : 0.0;
+
+		if(_json)
+		{
+			std::cout << std::fixed << std::setprecision(3);
+			std::cout << "{\"blocks\": " << st.blocks << ", \"instructions\": " << st.instructions << ", \"nodes\": " << st.nodes
+				<< ", \"codeBytes\": " << st.codeBytes << ", \"spillsToXmm\": " << st.spillsToXmm << ", \"spillsToMemory\": " << st.spillsToMemory
+				<< ", \"emitNs\": " << st.emitNs << ", \"finalizeNs\": " << st.finalizeNs << ", \"addNs\": " << st.addNs
+				<< ", \"codeBytesPerInstruction\": " << st.codeBytesPerInstruction() << ", \"blocksPerSecond\": " << blocksPerSecond << ", \"analysisNs\": " << analysisNs << "}" << std::endl;
+			return 0;
+		}
+
+		std::cout << std::fixed << std::setprecision(1);
+		std::cout << "Analysis                " << (analysisNs / 1000.0) << " us, " << analysis.getInstructionCount() << " instructions" << std::endl;
+		std::cout << "Blocks                  " << st.blocks << " (" << blocksPerSecond << " blocks/s)" << std::endl;
+		std::cout << "DSP instructions        " << st.instructions << " (" << (static_cast<double>(st.instructions) / blocks) << " per block)" << std::endl;
+		std::cout << "Builder nodes           " << st.nodes << " (" << (static_cast<double>(st.nodes) / blocks) << " per block)" << std::endl;
+		std::cout << "Host code bytes         " << st.codeBytes << " (" << st.codeBytesPerInstruction() << " per DSP instruction)" << std::endl;
+		std::cout << "Spills GP to XMM        " << st.spillsToXmm << std::endl;
+		std::cout << "Spills XMM to memory    " << st.spillsToMemory << std::endl;
+
+		auto phase = [&](const char* _name, const uint64_t _ns)
+		{
+			std::cout << _name << (static_cast<double>(_ns) / blocks) << " ns per block (" << (st.totalNs() ? 100.0 * static_cast<double>(_ns) / static_cast<double>(st.totalNs()) : 0.0) << "%)" << std::endl;
+		};
+
+		phase("Emit                    ", st.emitNs);
+		phase("Finalize                ", st.finalizeNs);
+		phase("Runtime add             ", st.addNs);
+
+		return 0;
+	}
+
+	std::string toJson(const std::vector<Result>& _results)
+	{
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(3);
+		ss << "[" << std::endl;
+
+		for(size_t i=0; i<_results.size(); ++i)
+		{
+			const auto& r = _results[i];
+			ss << "  {\"kernel\": \"" << r.kernel << "\", \"engine\": \"" << r.engine << "\", \"instructions\": " << r.instructions
+				<< ", \"nsPerInstruction\": " << r.nsPerInstruction << ", \"jitBlocks\": " << r.jitBlocks
+				<< ", \"jitCompileNsPerBlock\": " << r.jitCompileNsPerBlock << "}" << (i + 1 < _results.size() ? "," : "") << std::endl;
+		}
+
+		ss << "]" << std::endl;
+		return ss.str();
+	}
+}
+
+int main(int _argc, char* _argv[])
+{
+	const CommandLine cmd(_argc, _argv);
+
+	if(cmd.contains("help"))
+	{
+		std::cout << "DSP 56300 JIT/Interpreter Microbenchmarks" << std::endl;
+		std::cout << std::endl;
+		std::cout << "benchmark [-kernel name] [-engine jit|interpreter] [-instructions count] [-runs count] [-json [filename]]" << std::endl;
+		std::cout << "benchmark -compile inputfile [-json]" << std::endl;
+		std::cout << std::endl;
+		std::cout << "-kernel name         Run a single kernel only. Default: all" << std::endl;
+		std::cout << "-engine name         Run with a single engine only. Default: both" << std::endl;
+		std::cout << "-instructions count  Number of instructions per run. Default 20000000" << std::endl;
+		std::cout << "-runs count          Number of runs per kernel, the fastest one is reported. Default 3" << std::endl;
+		std::cout << "-json [filename]     Write results as JSON to a file or, without filename, to stdout" << std::endl;
+		std::cout << "-compile filename    Compile all reachable code of a program in OMF (.lod) format with the JIT and report compile statistics" << std::endl;
+		std::cout << std::endl;
+		std::cout << "Kernels:" << std::endl;
+		for(const auto& k : g_kernels)
+			std::cout << "  " << std::left << std::setw(12) << k.name << k.description << std::endl;
+		return 0;
+	}
+
+	if(cmd.contains("compile"))
+		return compileProgram(cmd.get("compile"), cmd.contains("json"));
+
+	const auto kernelName = cmd.tryGet("kernel");
+	const auto engine = cmd.tryGet("engine");
+	const auto instructions = std::max<uint64_t>(std::stoull(cmd.tryGet("instructions", "20000000")), 1);
+	const auto runs = std::max<uint32_t>(static_cast<uint32_t>(std::stoul(cmd.tryGet("runs", "3"))), 1);
+	const auto jsonFile = cmd.tryGet("json");
+
+	if(!engine.empty() && engine != "jit" && engine != "interpreter")
+	{
+		std::cout << "Unknown engine " << engine << std::endl;
+		return -1;
+	}
+
+	std::vector<Result> results;
+
+	for(const auto& k : g_kernels)
+	{
+		if(!kernelName.empty() && kernelName != k.name)
+			continue;
+
+		for(const bool interpreter : {false, true})
+		{
+			if(!engine.empty() && (engine == "interpreter") != interpreter)
+				continue;
+
+			results.push_back(benchmark(k, interpreter, instructions, runs));
+		}
+	}
+
+	if(results.empty())
+	{
+		std::cout << "Unknown kernel " << kernelName << std::endl;
+		return -1;
+	}
+
+	const auto json = toJson(results);
+
+	if(jsonFile.empty() && cmd.contains("json"))
+	{
+		std::cout << json;
+		return 0;
+	}
+
+	std::cout << std::left << std::setw(12) << "kernel" << std::setw(14) << "engine" << std::right << std::setw(12) << "ns/instr" << std::setw(10) << "MIPS" << std::setw(10) << "blocks" << std::setw(16) << "compile ns/blk" << std::endl;
+
+	for(const auto& r : results)
+	{
+		std::cout << std::left << std::setw(12) << r.kernel << std::setw(14) << r.engine << std::right << std::fixed
+			<< std::setprecision(3) << std::setw(12) << r.nsPerInstruction
+			<< std::setprecision(1) << std::setw(10) << (1000.0 / r.nsPerInstruction)
+			<< std::setw(10) << r.jitBlocks
+			<< std::setprecision(0) << std::setw(16) << r.jitCompileNsPerBlock << std::endl;
+	}
+
+	if(!jsonFile.empty())
+	{
+		std::ofstream out(jsonFile);
+		if(!out.is_open())
+		{
+			std::cout << "Failed to write " << jsonFile << std::endl;
+			return -1;
+		}
+		out << json;
+	}
+
+	return 0;
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <list>
@@ -5,11 +6,16 @@
 #include "commandline.h"
 
 #include "../dsp56kEmu/disasm.h"
+#include "dsp56kEmu/controlflowgraph.h"
+#include "dsp56kEmu/interrupts.h"
 #include "dsp56kEmu/memory.h"
 #include "dsp56kEmu/peripherals.h"
+#include "dsp56kEmu/programanalysis.h"
 
 using namespace dsp56k;
 
+DefaultMemoryValidator g_memoryMap;
+
 bool loadInputFile(std::vector<TWord>& _dst, const std::string& _filename, bool _bigEndian)
 {
 	std::ifstream file(_filename, std::ios::binary | std::ios::in);
@@ -130,6 +136,37 @@ bool loadInputFile(std::vector<TWord>& _dst, const std::string& _filename, bool
 	return true;
 }
 
+// Writes the control flow graph or the call graph of the code that is reachable from the interrupt vectors and an optional entry point
+bool writeGraph(std::ostream& _out, const std::vector<TWord>& _input, Disassembler& _disasm, const Opcodes& _opcodes, const std::string& _format, const std::string& _entry)
+{
+	Memory mem(g_memoryMap, std::max(static_cast<TWord>(_input.size()), static_cast<TWord>(Vba_End)));
+
+	for(size_t i=0; i<_input.size(); ++i)
+		mem.set(MemArea_P, static_cast<TWord>(i), _input[i]);
+
+	ProgramAnalysis analysis(mem, _opcodes, _disasm);
+
+	analysis.addVectors(0);
+
+	if(!_entry.empty())
+		analysis.addEntryPoint(static_cast<TWord>(std::stoul(_entry, nullptr, 16)));
+
+	analysis.analyze();
+
+	const ControlFlowGraph cfg(analysis);
+
+	if(_format == "dot")
+		cfg.writeDot(_out);
+	else if(_format == "calls")
+		cfg.writeCallGraphDot(_out);
+	else if(_format == "json")
+		cfg.writeJson(_out);
+	else
+		return false;
+
+	return true;
+}
+
 int main(int _argc, char* _argv[])
 {
 	try
@@ -142,7 +179,7 @@ int main(int _argc, char* _argv[])
 			std::cout << std::endl;
 			std::cout << "Usage:" << std::endl;
 			std::cout << std::endl;
-			std::cout << "disassemble -in inputfile [-out outputfile]" << std::endl;
+			std::cout << "disassemble -in inputfile [-out outputfile] [-graph dot|calls|json] [-entry address]" << std::endl;
 			std::cout << std::endl;
 			std::cout << "";
 			std::cout << std::endl;
@@ -150,6 +187,11 @@ int main(int _argc, char* _argv[])
 			std::cout << "-in filename     Input file, required. Input may either be a file with ASCII text in form 0055ff aabbcc FF0022 ... or binary content." << std::endl;
 			std::cout << "-out filename    Write output to a text file. May be omitted, in which case output is written to standard output." << std::endl;
 			std::cout << "le               Specify that the input file is in Little-Endian format. By default, input bytes are treated as being Big-Endian." << std::endl;
+			std::cout << "-graph format    Instead of a listing, write the graph of all code that is reachable from the interrupt vectors. Formats:" << std::endl;
+			std::cout << "                 dot   basic block control flow graph in Graphviz format, loops are drawn as nested clusters" << std::endl;
+			std::cout << "                 calls call graph in Graphviz format" << std::endl;
+			std::cout << "                 json  basic blocks with edges, loop nesting, estimated instruction counts, and the call graph" << std::endl;
+			std::cout << "-entry address   Additional entry point for -graph, hexadecimal." << std::endl;
 			std::cout << std::endl;
 			std::cout << "Output format:" << std::endl;
 			std::cout << "[address] - [opcode word A] [opcode word B] = [assembly]" << std::endl;
@@ -189,6 +231,16 @@ int main(int _argc, char* _argv[])
 		Peripherals56362 p;
 		p.setSymbols(disasm);	
 
+		if(cmd.contains("graph"))
+		{
+			if(!writeGraph(out, input, disasm, opcodes, cmd.get("graph"), cmd.tryGet("entry")))
+			{
+				std::cout << "Unknown graph format " << cmd.get("graph") << std::endl;
+				return -1;
+			}
+			return 0;
+		}
+
 		std::string assembly;
 		disasm.disassembleMemoryBlock(assembly, input, 0, true, true, true);
 
@@ -1,5 +1,7 @@
 #include "audio.h"
 
+#include "snapshot.h"
+
 namespace dsp56k
 {
 	TWord Audio::readRXimpl(size_t _index)
@@ -21,4 +23,20 @@ namespace dsp56k
 		if (m_callback && _index==m_callbackChannels-1 && m_audioOutputs[_index].size()>=m_callbackSamples*2)
 			m_callback(this);
 	}
+
+	void Audio::saveState(SnapshotWriter& _writer) const
+	{
+		_writer.write(m_frameSyncDSPStatus);
+		_writer.write(m_frameSyncDSPRead);
+		_writer.write(m_frameSyncDSPWrite);
+		_writer.write(m_frameSyncAudio);
+	}
+
+	bool Audio::loadState(SnapshotReader& _reader)
+	{
+		_reader.read(m_frameSyncDSPStatus);
+		_reader.read(m_frameSyncDSPRead);
+		_reader.read(m_frameSyncDSPWrite);
+		return _reader.read(m_frameSyncAudio);
+	}
 }
@@ -11,6 +11,9 @@
 
 namespace dsp56k
 {	
+	class SnapshotReader;
+	class SnapshotWriter;
+
 	constexpr float g_float2dspScale	= 8388608.0f;
 	constexpr float g_dsp2FloatScale	= 0.00000011920928955078125f;
 	constexpr float g_dspFloatMax		= 8388607.0f;
@@ -132,6 +135,10 @@ namespace dsp56k
 		TWord readRXimpl(size_t _index);
 		void writeTXimpl(size_t _index, TWord _val);
 
+		// audio data itself is streamed by the host and not part of the state
+		void saveState(SnapshotWriter& _writer) const;
+		bool loadState(SnapshotReader& _reader);
+
 		AudioCallback m_callback;
 
 		size_t m_callbackSamples = 0;
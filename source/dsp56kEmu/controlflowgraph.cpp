@@ -0,0 +1,411 @@
+#include "controlflowgraph.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+#include "opcodes.h"
+
+namespace dsp56k
+{
+	namespace
+	{
+		std::string hex(const TWord _value)
+		{
+			char temp[16];
+			snprintf(temp, sizeof(temp), "%06x", _value);
+			return temp;
+		}
+
+		template<typename T> void writeJsonArray(std::ostream& _out, const T& _values)
+		{
+			_out << '[';
+			bool first = true;
+			for(const auto v : _values)
+			{
+				if(!first)
+					_out << ", ";
+				_out << v;
+				first = false;
+			}
+			_out << ']';
+		}
+
+		void writeJsonAddress(std::ostream& _out, const TWord _address)
+		{
+			if(_address == g_invalidAddress)
+				_out << "null";
+			else
+				_out << _address;
+		}
+	}
+
+	ControlFlowGraph::ControlFlowGraph(const ProgramAnalysis& _analysis) : m_analysis(_analysis)
+	{
+		for(const auto& it : _analysis.getBlockStarts())
+			createBlock(it.first);
+
+		// branches to addresses that are out of range or do not decode to valid instructions
+		for(auto& it : m_blocks)
+		{
+			auto& edges = it.second.edges;
+
+			for(auto e = edges.begin(); e != edges.end();)
+			{
+				if(m_blocks.find(e->target) == m_blocks.end())
+					e = edges.erase(e);
+				else
+					++e;
+			}
+		}
+
+		std::set<TWord> entries = _analysis.getEntryPoints();
+
+		for(const auto& it : m_blocks)
+		{
+			for(const auto& e : it.second.edges)
+			{
+				if(e.type == EdgeType::Call)
+					entries.insert(e.target);
+			}
+		}
+
+		for(const auto entry : entries)
+		{
+			if(m_blocks.find(entry) != m_blocks.end())
+				createFunction(entry, entries);
+		}
+	}
+
+	uint32_t ControlFlowGraph::getLoopDepth(TWord _loop) const
+	{
+		const auto& loops = m_analysis.getLoops();
+
+		uint32_t depth = 0;
+
+		while(_loop != g_invalidAddress)
+		{
+			const auto it = loops.find(_loop);
+			if(it == loops.end())
+				break;
+
+			++depth;
+			_loop = it->second.parent;
+		}
+
+		return depth;
+	}
+
+	const char* ControlFlowGraph::getEdgeTypeName(const EdgeType _type)
+	{
+		switch (_type)
+		{
+		case EdgeType::FallThrough:	return "fallthrough";
+		case EdgeType::Branch:		return "branch";
+		case EdgeType::Call:		return "call";
+		case EdgeType::LoopBack:	return "loopback";
+		case EdgeType::LoopExit:	return "loopexit";
+		}
+		return "";
+	}
+
+	void ControlFlowGraph::writeDot(std::ostream& _out) const
+	{
+		_out << "digraph cfg" << std::endl << '{' << std::endl;
+		_out << "\tnode [shape=box, fontname=\"Courier\"];" << std::endl;
+
+		for(const auto& it : m_blocks)
+		{
+			if(it.second.loop == g_invalidAddress)
+				writeDotBlock(_out, it.second, "\t");
+		}
+
+		for(const auto& it : m_analysis.getLoops())
+		{
+			if(it.second.parent == g_invalidAddress)
+				writeDotLoop(_out, it.first, "\t");
+		}
+
+		for(const auto& it : m_blocks)
+		{
+			for(const auto& e : it.second.edges)
+			{
+				_out << "\tb" << hex(it.first) << " -> b" << hex(e.target);
+
+				switch (e.type)
+				{
+				case EdgeType::Call:		_out << " [style=dashed]";	break;
+				case EdgeType::LoopBack:	_out << " [style=bold]";	break;
+				case EdgeType::LoopExit:	_out << " [style=dotted]";	break;
+				default:												break;
+				}
+
+				_out << ';' << std::endl;
+			}
+		}
+
+		_out << '}' << std::endl;
+	}
+
+	void ControlFlowGraph::writeCallGraphDot(std::ostream& _out) const
+	{
+		_out << "digraph calls" << std::endl << '{' << std::endl;
+		_out << "\tnode [shape=box, fontname=\"Courier\"];" << std::endl;
+
+		for(const auto& it : m_functions)
+		{
+			const auto& f = it.second;
+
+			uint64_t instructions = 0;
+			for(const auto b : f.blocks)
+				instructions += m_blocks.at(b).instructions;
+
+			_out << "\tf" << hex(f.entry) << " [label=\"$" << hex(f.entry) << "\\n" << f.blocks.size() << " blocks, " << instructions << " instructions\"";
+			if(m_analysis.isVector(f.entry))
+				_out << ", style=bold";
+			_out << "];" << std::endl;
+		}
+
+		for(const auto& it : m_functions)
+		{
+			for(const auto callee : it.second.callees)
+				_out << "\tf" << hex(it.first) << " -> f" << hex(callee) << ';' << std::endl;
+		}
+
+		_out << '}' << std::endl;
+	}
+
+	void ControlFlowGraph::writeJson(std::ostream& _out) const
+	{
+		_out << '{' << std::endl;
+
+		_out << "\t\"blocks\": [";
+		bool first = true;
+
+		for(const auto& it : m_blocks)
+		{
+			const auto& b = it.second;
+
+			_out << (first ? "" : ",") << std::endl;
+			first = false;
+
+			_out << "\t\t{\"begin\": " << b.begin << ", \"end\": " << b.end << ", \"instructions\": " << b.instructions << ", \"estimatedInstructions\": " << b.estimatedInstructions;
+			_out << ", \"loop\": ";
+			writeJsonAddress(_out, b.loop);
+			_out << ", \"loopDepth\": " << b.loopDepth << ", \"dynamicBranch\": " << (b.dynamicBranch ? "true" : "false") << ", \"edges\": [";
+
+			for(size_t i=0; i<b.edges.size(); ++i)
+				_out << (i ? ", " : "") << "{\"target\": " << b.edges[i].target << ", \"type\": \"" << getEdgeTypeName(b.edges[i].type) << "\"}";
+
+			_out << "]}";
+		}
+
+		_out << std::endl << "\t]," << std::endl;
+
+		_out << "\t\"loops\": [";
+		first = true;
+
+		for(const auto& it : m_analysis.getLoops())
+		{
+			const auto& l = it.second;
+
+			_out << (first ? "" : ",") << std::endl;
+			first = false;
+
+			_out << "\t\t{\"begin\": " << l.begin << ", \"end\": " << l.end << ", \"iterations\": " << l.iterations << ", \"parent\": ";
+			writeJsonAddress(_out, l.parent);
+			_out << ", \"depth\": " << getLoopDepth(l.begin) << '}';
+		}
+
+		_out << std::endl << "\t]," << std::endl;
+
+		_out << "\t\"functions\": [";
+		first = true;
+
+		for(const auto& it : m_functions)
+		{
+			const auto& f = it.second;
+
+			_out << (first ? "" : ",") << std::endl;
+			first = false;
+
+			_out << "\t\t{\"entry\": " << f.entry << ", \"vector\": " << (m_analysis.isVector(f.entry) ? "true" : "false") << ", \"blocks\": ";
+			writeJsonArray(_out, f.blocks);
+			_out << ", \"callees\": ";
+			writeJsonArray(_out, f.callees);
+			_out << '}';
+		}
+
+		_out << std::endl << "\t]" << std::endl;
+		_out << '}' << std::endl;
+	}
+
+	void ControlFlowGraph::createBlock(const TWord _begin)
+	{
+		const auto& starts = m_analysis.getBlockStarts();
+		const auto& loop = starts.at(_begin);
+
+		BasicBlock b;
+		b.begin = _begin;
+		b.loop = loop.begin;
+		b.loopDepth = getLoopDepth(loop.begin);
+
+		// a fast interrupt executes two words and returns to the interrupted code
+		const TWord pcMax = m_analysis.isVector(_begin) ? _begin + 2 : g_invalidAddress;
+
+		uint64_t repeat = 1;
+		TWord pc = _begin;
+
+		while(pc < pcMax && m_analysis.isReachable(pc))
+		{
+			if(pc != _begin && starts.find(pc) != starts.end())
+			{
+				b.edges.push_back({pc, EdgeType::FallThrough});
+				break;
+			}
+
+			ProgramAnalysis::Op op;
+
+			if(!m_analysis.decode(op, pc))
+				break;
+
+			++b.instructions;
+			b.estimatedInstructions += repeat;
+			repeat = 1;
+
+			const TWord current = pc;
+			pc += op.len;
+
+			if(op.oi)
+			{
+				const auto& oi = *op.oi;
+
+				if(oi.flag(OpFlagRepImmediate))
+				{
+					repeat = std::max<TWord>(1, getFieldValue(oi.getInstruction(), Field_hhhh, Field_iiiiiiii, op.opA));
+				}
+				else if(oi.flag(OpFlagLoop) && !oi.flag(OpFlagRepDynamic))
+				{
+					b.edges.push_back({pc, EdgeType::FallThrough});
+
+					const auto it = m_analysis.getLoops().find(pc);
+					if(it != m_analysis.getLoops().end())
+						b.edges.push_back({it->second.end + 1, EdgeType::LoopExit});
+					break;
+				}
+				else if(oi.flag(OpFlagBranch))
+				{
+					const auto target = getBranchTarget(oi.getInstruction(), op.opA, op.opB, current);
+
+					if(target == g_dynamicAddress)
+						b.dynamicBranch = true;
+					else if(target != g_invalidAddress)
+						b.edges.push_back({target, oi.flag(OpFlagPushPC) ? EdgeType::Call : EdgeType::Branch});
+
+					if(pcMax == g_invalidAddress && oi.flags(OpFlagCondition, OpFlagPushPC))
+						b.edges.push_back({pc, EdgeType::FallThrough});
+					break;
+				}
+				else if(oi.flag(OpFlagPopPC))
+				{
+					break;
+				}
+			}
+
+			if(current == loop.end)
+			{
+				b.edges.push_back({loop.begin, EdgeType::LoopBack});
+				b.edges.push_back({loop.end + 1, EdgeType::LoopExit});
+				break;
+			}
+		}
+
+		b.end = pc;
+
+		// multiply by the iterations of all enclosing loops with a known count
+		for(auto l = loop.begin; l != g_invalidAddress;)
+		{
+			const auto& outer = m_analysis.getLoops().at(l);
+
+			if(outer.iterations)
+				b.estimatedInstructions *= outer.iterations;
+
+			l = outer.parent;
+		}
+
+		m_blocks.emplace(_begin, std::move(b));
+	}
+
+	void ControlFlowGraph::createFunction(const TWord _entry, const std::set<TWord>& _entries)
+	{
+		Function f;
+		f.entry = _entry;
+
+		std::vector<TWord> pending{_entry};
+
+		while(!pending.empty())
+		{
+			const auto pc = pending.back();
+			pending.pop_back();
+
+			if(!f.blocks.insert(pc).second)
+				continue;
+
+			for(const auto& e : m_blocks.at(pc).edges)
+			{
+				// code that continues in another function, i.e. a tail call, is treated like a call
+				if(e.type == EdgeType::Call || (e.target != _entry && _entries.find(e.target) != _entries.end()))
+					f.callees.insert(e.target);
+				else
+					pending.push_back(e.target);
+			}
+		}
+
+		m_functions.emplace(_entry, std::move(f));
+	}
+
+	void ControlFlowGraph::writeDotBlock(std::ostream& _out, const BasicBlock& _block, const std::string& _indent) const
+	{
+		_out << _indent << 'b' << hex(_block.begin) << " [label=\"$" << hex(_block.begin) << "\\n" << _block.instructions << " instructions";
+
+		if(_block.estimatedInstructions != _block.instructions)
+			_out << ", est. " << _block.estimatedInstructions;
+
+		if(_block.dynamicBranch)
+			_out << "\\ndynamic branch";
+
+		_out << '"';
+
+		if(m_analysis.getEntryPoints().find(_block.begin) != m_analysis.getEntryPoints().end())
+			_out << ", style=bold";
+
+		_out << "];" << std::endl;
+	}
+
+	void ControlFlowGraph::writeDotLoop(std::ostream& _out, const TWord _loop, const std::string& _indent) const
+	{
+		const auto& loop = m_analysis.getLoops().at(_loop);
+
+		_out << _indent << "subgraph cluster_" << hex(_loop) << std::endl << _indent << '{' << std::endl;
+		_out << _indent << "\tlabel=\"loop $" << hex(loop.begin) << "-$" << hex(loop.end);
+
+		if(loop.iterations)
+			_out << " x" << loop.iterations;
+
+		_out << "\";" << std::endl;
+
+		for(const auto& it : m_blocks)
+		{
+			if(it.second.loop == _loop)
+				writeDotBlock(_out, it.second, _indent + '\t');
+		}
+
+		for(const auto& it : m_analysis.getLoops())
+		{
+			if(it.second.parent == _loop)
+				writeDotLoop(_out, it.first, _indent + '\t');
+		}
+
+		_out << _indent << '}' << std::endl;
+	}
+}
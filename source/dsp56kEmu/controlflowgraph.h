@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "programanalysis.h"
+
+namespace dsp56k
+{
+	// Basic block control flow graph and call graph of all code that has been discovered by a ProgramAnalysis
+	class ControlFlowGraph
+	{
+	public:
+		enum class EdgeType
+		{
+			FallThrough,	// next instruction, including the return address of a subroutine call and the first instruction of a loop body
+			Branch,			// static branch target
+			Call,			// subroutine call, jsr / bsr
+			LoopBack,		// loop end to the start of the loop body
+			LoopExit,		// DO and loop end to the first instruction after the loop
+		};
+
+		struct Edge
+		{
+			TWord target;
+			EdgeType type;
+		};
+
+		struct BasicBlock
+		{
+			TWord begin = 0;
+			TWord end = 0;						// first address after the block
+			uint32_t instructions = 0;
+			uint64_t estimatedInstructions = 0;	// executed instructions, rep and loops with an immediate count multiplied out
+			TWord loop = g_invalidAddress;		// begin of the innermost loop
+			uint32_t loopDepth = 0;
+			bool dynamicBranch = false;			// ends with a branch whose target is not known at compile time
+			std::vector<Edge> edges;
+		};
+
+		// subroutine, interrupt service routine or entry point. Includes all blocks that are reachable without a call
+		struct Function
+		{
+			TWord entry = 0;
+			std::set<TWord> blocks;
+			std::set<TWord> callees;
+		};
+
+		explicit ControlFlowGraph(const ProgramAnalysis& _analysis);
+
+		const std::map<TWord, BasicBlock>& getBlocks() const { return m_blocks; }
+		const std::map<TWord, Function>& getFunctions() const { return m_functions; }
+
+		uint32_t getLoopDepth(TWord _loop) const;
+
+		static const char* getEdgeTypeName(EdgeType _type);
+
+		void writeDot(std::ostream& _out) const;
+		void writeCallGraphDot(std::ostream& _out) const;
+		void writeJson(std::ostream& _out) const;
+
+	private:
+		void createBlock(TWord _begin);
+		void createFunction(TWord _entry, const std::set<TWord>& _entries);
+		void writeDotBlock(std::ostream& _out, const BasicBlock& _block, const std::string& _indent) const;
+		void writeDotLoop(std::ostream& _out, TWord _loop, const std::string& _indent) const;
+
+		const ProgramAnalysis& m_analysis;
+
+		std::map<TWord, BasicBlock> m_blocks;
+		std::map<TWord, Function> m_functions;
+	};
+}
@@ -23,6 +23,10 @@
 #include "dsp_jumptable.inl"
 
 #include "jit.h"
+#include "peripherals.h"
+#include "programanalysis.h"
+#include "snapshot.h"
+#include "tracerecorder.h"
 
 #if 0
 #	define LOGSC(F)	logSC(F)
@@ -37,6 +41,56 @@ namespace dsp56k
 	constexpr bool g_traceSupported = false;
 	constexpr bool g_useJIT = g_jitSupported;
 
+	constexpr TWord g_maxIdleInstructions = 0x10000;					// upper limit for skipping instructions in a single idle loop iteration
+	constexpr std::chrono::microseconds g_idleWaitTimeout(1000);		// max time to wait for host input if nothing is scheduled
+
+	bool DSP::useJit() const
+	{
+		return g_useJIT && !m_interpreterOnly;
+	}
+
+	void DSP::setInterpreterOnly(const bool _interpreterOnly)
+	{
+		m_interpreterOnly = _interpreterOnly;
+
+		// blocks of a shared code cache must not wait for us while we do not use the JIT
+		if(m_interpreterOnly)
+			m_jit.goOffline();
+	}
+
+	uint64_t DSP::precompile()
+	{
+		if(!useJit())
+			return 0;
+
+		return precompile(analyzeProgram());
+	}
+
+	uint64_t DSP::precompile(const ProgramAnalysis& _analysis)
+	{
+		if(!useJit())
+			return 0;
+
+		return m_jit.precompile(_analysis);
+	}
+
+	ProgramAnalysis DSP::analyzeProgram()
+	{
+		ProgramAnalysis analysis(mem, m_opcodes, m_disasm);
+
+		analysis.addEntryPoint(reg.pc.var);
+		analysis.addVectors(reg.vba.var);
+		analysis.analyze();
+
+		return analysis;
+	}
+
+	void DSP::notifyProgramLoaded()
+	{
+		if(m_precompileOnLoad)
+			precompile();
+	}
+
 	Jumptable g_jumptable;
 
 	// _____________________________________________________________________________
@@ -122,7 +176,7 @@ namespace dsp56k
 		// we do not support 16-bit compatibility mode
 		assert( (reg.sr.var & SR_SC) == 0 && "16 bit compatibility mode is not supported");
 
-		if(g_useJIT)
+		if(useJit())
 		{
 			if(m_processingMode == Default)
 			{
@@ -136,7 +190,17 @@ namespace dsp56k
 				m_processingMode = Default;
 			}
 
-			m_jit.exec(getPC().var);
+			const auto pc = getPC().var;
+			const auto instructions = m_instructions;
+
+			m_jit.exec(pc);
+			m_telemetry.add(TelemetryCounter::DispatcherExits);
+
+			if(m_traceRecorder)
+				m_jit.traceBlock(*m_traceRecorder, pc, m_instructions - instructions);
+
+			if(m_idleLoopSkipping && reg.pc.var == pc)
+				idle(pc);
 		}
 		else
 		{
@@ -164,6 +228,17 @@ namespace dsp56k
 		}
 	}
 
+	void DSP::exec(const uint32_t _instructions)
+	{
+		const auto iBegin = m_instructions;
+
+		// return to the caller after waiting for host input, it might have something to do
+		m_idleWaited = false;
+
+		while(m_instructions - iBegin < _instructions && !m_idleWaited)
+			exec();
+	}
+
 	void DSP::execPeriph()
 	{
 		const auto diff = m_peripheralCounter - m_instructions;
@@ -176,6 +251,34 @@ namespace dsp56k
 		perif[0]->exec();
 	}
 
+	void DSP::idle(const TWord _pc)
+	{
+		// The block at _pc polls a peripheral bit and branches to itself. Nothing changes until a peripheral does, skip ahead to its next event
+		if(m_processingMode != Default || !m_pendingInterrupts.empty() || !m_jit.isIdleLoop(_pc))
+			return;
+
+		const auto instructions = std::min(perif[0]->getInstructionsUntilNextEvent(), g_maxIdleInstructions);
+
+		if(!instructions)
+		{
+			// nothing scheduled, only the host can change the state we are waiting for. injectInterrupt() wakes us up if it sees
+			// m_idleWaiting, an interrupt injected before that is caught by checking the pending interrupts again
+			m_jit.goOffline();
+
+			m_idleWaiting = true;
+			m_idleWaited = m_pendingInterrupts.empty() && perif[0]->waitForInput(g_idleWaitTimeout);
+			m_idleWaiting = false;
+			return;
+		}
+
+		m_instructions += instructions;
+
+		// make sure that the peripherals run on the next exec()
+		m_peripheralCounter = m_instructions;
+
+		m_telemetry.add(TelemetryCounter::IdleInstructions, instructions);
+	}
+
 	void DSP::tryExecInterrupts()
 	{
 		if (!m_pendingInterrupts.empty())
@@ -192,12 +295,20 @@ namespace dsp56k
 
 		const auto vba = m_pendingInterrupts.pop_front();
 
+		m_telemetry.add(TelemetryCounter::Interrupts);
+
 		pcCurrentInstruction = vba;
 		m_processingMode = FastInterrupt;
 
-		if(g_useJIT)
+		if(useJit())
 		{
+			const auto instructions = m_instructions;
+
 			m_jit.exec(vba);
+
+			if(m_traceRecorder)
+				m_jit.traceBlock(*m_traceRecorder, vba, m_instructions - instructions);
+
 			if(m_processingMode != LongInterrupt)
 			{
 				m_processingMode = DefaultPreventInterrupt;
@@ -308,6 +419,9 @@ namespace dsp56k
 
 			if(g_traceSupported && pcCurrentInstruction == currentOp)
 				traceOp();
+
+			if(m_traceRecorder)
+				recordOp();
 		}
 	}
 
@@ -474,6 +588,9 @@ namespace dsp56k
 
 		traceOp();
 
+		if(m_traceRecorder)
+			recordOp();
+
 		// __________________
 		//
 
@@ -530,6 +647,9 @@ namespace dsp56k
 
 		traceOp();
 
+		if(m_traceRecorder)
+			recordOp();
+
 		pcCurrentInstruction = reg.pc.var;
 		const auto op = fetchPC();
 
@@ -546,6 +666,9 @@ namespace dsp56k
 			(this->*func)(op);
 			++m_instructions;
 			traceOp();
+
+			if(m_traceRecorder)
+				recordOp();
 		}
 
 		reg.lc = lcBackup;
@@ -553,6 +676,11 @@ namespace dsp56k
 		return true;
 	}
 
+	void DSP::recordOp()
+	{
+		m_traceRecorder->record(*this, pcCurrentInstruction, memRead(MemArea_P, pcCurrentInstruction), m_opWordB, m_currentOpLen);
+	}
+
 	void DSP::traceOp()
 	{
 		if(!g_traceSupported || !m_trace)
@@ -1221,6 +1349,82 @@ namespace dsp56k
 		return true;
 	}
 
+	// _____________________________________________________________________________
+	// saveState / loadState
+	//
+	namespace
+	{
+		constexpr DSP::TInterruptFunc g_snapshotInterruptFuncs[] =
+		{
+			&DSP::execNoPendingInterrupts,
+			&DSP::tryExecInterrupts,
+			&DSP::execInterrupts,
+			&DSP::execDefaultPreventInterrupt,
+			&DSP::nop
+		};
+	}
+
+	bool DSP::saveState(SnapshotWriter& _writer)
+	{
+		uint32_t interruptFunc = 0;
+		while(interruptFunc < std::size(g_snapshotInterruptFuncs) && g_snapshotInterruptFuncs[interruptFunc] != m_interruptFunc)
+			++interruptFunc;
+
+		if(interruptFunc == std::size(g_snapshotInterruptFuncs))
+		{
+			LOG("Unable to create snapshot, interrupt state function is unknown");
+			return false;
+		}
+
+		_writer.write(reg);
+		_writer.write(ccrCache);
+		_writer.write(cache);
+
+		_writer.write(pcCurrentInstruction);
+		_writer.write(m_opWordB);
+		_writer.write(m_currentOpLen);
+		_writer.write(m_instructions);
+		_writer.write(m_peripheralCounter);
+		_writer.write(m_processingMode);
+		_writer.write(interruptFunc);
+
+		_writer.write(m_pendingInterrupts);
+
+		perif[0]->saveState(_writer);
+		if(perif[1] != perif[0])
+			perif[1]->saveState(_writer);
+		return true;
+	}
+
+	bool DSP::loadState(SnapshotReader& _reader)
+	{
+		_reader.read(reg);
+		_reader.read(ccrCache);
+		_reader.read(cache);
+
+		_reader.read(pcCurrentInstruction);
+		_reader.read(m_opWordB);
+		_reader.read(m_currentOpLen);
+		_reader.read(m_instructions);
+		_reader.read(m_peripheralCounter);
+		_reader.read(m_processingMode);
+
+		uint32_t interruptFunc = 0;
+		_reader.read(interruptFunc);
+		if(interruptFunc >= std::size(g_snapshotInterruptFuncs))
+			return false;
+		m_interruptFunc = g_snapshotInterruptFuncs[interruptFunc];
+
+		_reader.read(m_pendingInterrupts);
+
+		if(!perif[0]->loadState(_reader))
+			return false;
+		if(perif[1] != perif[0] && !perif[1]->loadState(_reader))
+			return false;
+
+		return !_reader.hasError();
+	}
+
 	void DSP::injectInterrupt(uint32_t _interruptVectorAddress)
 	{
 //		assert(!m_pendingInterrupts.full());
@@ -1228,6 +1432,15 @@ namespace dsp56k
 
 		if(m_interruptFunc == &DSP::execNoPendingInterrupts)
 			m_interruptFunc = &DSP::tryExecInterrupts;
+
+		if(m_idleWaiting)
+			wakeUp();
+	}
+
+	void DSP::wakeUp()
+	{
+		for(size_t i=0; i<perif.size(); ++i)
+			perif[i]->wakeUp();
 	}
 
 	void DSP::clearOpcodeCache()
@@ -1241,6 +1454,14 @@ namespace dsp56k
 		m_opcodeCache[_address].op = &DSP::op_ResolveCache;
 		m_jit.notifyProgramMemWrite(_address);
 	}
+
+	void DSP::clearOpcodeCache(const TWord _address, const TWord _count)
+	{
+		for(TWord i=0; i<_count; ++i)
+			m_opcodeCache[_address + i].op = &DSP::op_ResolveCache;
+
+		m_jit.notifyProgramMemWrite(_address, _count);
+	}
 	
 	TInstructionFunc DSP::resolvePermutation(const Instruction _inst, const TWord _op)
 	{
@@ -9,15 +9,20 @@
 #include "logging.h"
 #include "jit.h"
 #include "dsplistener.h"
+#include "telemetry.h"
 
 namespace dsp56k
 {
 	class Memory;
+	class ProgramAnalysis;
 	class UnitTests;
 	class JitUnittests;
 	class JitDspRegs;
 	class JitOps;
 	class AotRuntime;
+	class SnapshotReader;
+	class SnapshotWriter;
+	class TraceRecorder;
 	
 	using TInstructionFunc = void (DSP::*)(TWord _op);
 
@@ -169,6 +174,16 @@ namespace dsp56k
 
 		DSPListener*	m_listener = nullptr;
 
+		Telemetry		m_telemetry;
+
+		TraceRecorder*	m_traceRecorder = nullptr;
+
+		bool			m_interpreterOnly = false;
+		bool			m_idleLoopSkipping = true;
+		bool			m_precompileOnLoad = false;
+		std::atomic<bool>	m_idleWaiting{false};	// DSP thread is blocked in idle() waiting for host input
+		bool			m_idleWaited = false;
+
 		// _____________________________________________________________________________
 		// implementation
 		//
@@ -187,7 +202,12 @@ namespace dsp56k
 		TReg24	getPC							() const									{ return reg.pc; }
 
 		void 	exec							();
+
+		// Executes at least _instructions instructions, the JIT always runs the last block to its end. Returns early if the DSP waited for host input
+		void 	exec							(uint32_t _instructions);
+
 		void	execPeriph						();
+		void	idle							(TWord _pc);
 		void	tryExecInterrupts				();
 		void	execInterrupts					();
 		void	execDefaultPreventInterrupt		();
@@ -222,10 +242,18 @@ namespace dsp56k
 		bool			save							( FILE* _file ) const;
 		bool			load							( FILE* _file );
 
+		// complete state including pending interrupts and peripherals, memory is not included. See Snapshot
+		bool			saveState						( SnapshotWriter& _writer );
+		bool			loadState						( SnapshotReader& _reader );
+
 		void			injectInterrupt					(uint32_t _interruptVectorAddress);
 
+		// Makes the DSP return from waiting for host input in an idle loop. Can be called from any thread
+		void			wakeUp							();
+
 		void			clearOpcodeCache				();
 		void			clearOpcodeCache				(TWord _address);
+		void			clearOpcodeCache				(TWord _address, TWord _count);
 
 		void			dumpRegisters					() const;
 		void			dumpRegisters					(std::stringstream& _ss) const;
@@ -237,7 +265,7 @@ namespace dsp56k
 		const Opcodes&	opcodes							() const									{ return m_opcodes; }
 		Disassembler&	disassembler					()											{ return m_disasm; }
 
-		void			setPeriph						(const size_t _index, IPeripherals* _periph)	{ perif[_index] = _periph; _periph->setDSP(this); }
+		void			setPeriph						(const size_t _index, IPeripherals* _periph)	{ perif[_index] = _periph; _periph->setDSP(this); m_jit.notifyPeripheralsChanged(); }
 		IPeripherals*	getPeriph						(const size_t _index)							{ return perif[_index]; }
 		
 		ProcessingMode getProcessingMode() const		{return m_processingMode;}
@@ -247,6 +275,32 @@ namespace dsp56k
 		void			terminate						();
 
 		void			setListener						(DSPListener* _listener) { m_listener = _listener; }
+
+		// Executes all code with the interpreter, used to validate the JIT. Set this before execution starts
+		// Call from the thread that runs the DSP or while it is not running
+		void			setInterpreterOnly				(bool _interpreterOnly);
+		bool			useJit							() const;
+
+		// Compiles all code that is statically reachable from the current PC and the interrupt vectors, call after the program has been loaded.
+		// Returns the number of compiled blocks. This modifies the JIT, do not call it while the DSP is running on another thread but use DSPThread::execAtSafePoint
+		uint64_t		precompile						();
+		uint64_t		precompile						(const ProgramAnalysis& _analysis);
+
+		// The analysis that precompile is based on. It does not touch the JIT
+		ProgramAnalysis	analyzeProgram					();
+
+		// Called by Memory after a program has been loaded, precompiles it if enabled. Disabled by default as it runs on the thread that loads the program
+		void			notifyProgramLoaded				();
+		void			setPrecompileOnLoad				(const bool _enable)						{ m_precompileOnLoad = _enable; }
+
+		// If the JIT detects a loop that does nothing but poll a peripheral, the instruction counter is advanced to the next peripheral event instead of running the loop
+		void			setIdleLoopSkipping				(const bool _enable)						{ m_idleLoopSkipping = _enable; }
+
+		void			setTraceRecorder				(TraceRecorder* _recorder)					{ m_traceRecorder = _recorder; }
+		TraceRecorder*	getTraceRecorder				() const									{ return m_traceRecorder; }
+
+		Telemetry&		getTelemetry					()											{ return m_telemetry; }
+		const Telemetry& getTelemetry					() const									{ return m_telemetry; }
 	private:
 
 		std::string getSSindent() const;
@@ -280,6 +334,7 @@ namespace dsp56k
 		bool	rep_exec						(TWord _loopCount);
 
 		void	traceOp							();
+		void	recordOp						();
 		void	traceOp							(TWord _pc, TWord _opA, TWord _opB, TWord _opLen);
 
 		// -- decoding helper functions
@@ -0,0 +1,254 @@
+#include "dspscheduler.h"
+
+#include <algorithm>
+
+#include "dsp.h"
+
+namespace dsp56k
+{
+	DSPScheduler::DSPScheduler(size_t _workerCount/* = 0*/, const uint32_t _sliceInstructions/* = 4096*/) : m_sliceInstructions(std::max(_sliceInstructions, 8u))
+	{
+		if(!_workerCount)
+			_workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+		m_workers.reserve(_workerCount);
+
+		for(size_t i=0; i<_workerCount; ++i)
+			m_workers.emplace_back(new Worker());
+
+		// all workers need to exist before the first one starts as they steal from each other
+		for(size_t i=0; i<_workerCount; ++i)
+		{
+			m_workers[i]->thread = std::thread([this, i]
+			{
+				workerFunc(i);
+			});
+		}
+	}
+
+	DSPScheduler::~DSPScheduler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_runThreads = false;
+
+			// unblock instances that wait for peripherals
+			for (const auto& instance : m_instances)
+				instance->dsp.terminate();
+		}
+
+		m_cvIdle.notify_all();
+
+		for (const auto& w : m_workers)
+			w->thread.join();
+	}
+
+	void DSPScheduler::add(DSP& _dsp, CanRunFunc _canRun/* = CanRunFunc()*/)
+	{
+		auto instance = std::make_shared<Instance>(_dsp, std::move(_canRun));
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_instances.push_back(instance);
+		}
+
+		pushInstance(m_nextWorker++ % m_workers.size(), std::move(instance));
+
+		notifyWork();
+	}
+
+	void DSPScheduler::wakeUp()
+	{
+		notifyWork();
+	}
+
+	void DSPScheduler::notifyWork()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_workGeneration;
+		}
+		m_cvIdle.notify_one();
+	}
+
+	bool DSPScheduler::remove(const DSP& _dsp)
+	{
+		InstancePtr instance;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			const auto it = std::find_if(m_instances.begin(), m_instances.end(), [&](const InstancePtr& _i)
+			{
+				return &_i->dsp == &_dsp;
+			});
+
+			if(it == m_instances.end())
+				return false;
+
+			instance = *it;
+			m_instances.erase(it);
+
+			instance->removed = true;
+
+			const auto itParked = std::find(m_parked.begin(), m_parked.end(), instance);
+			if(itParked != m_parked.end())
+			{
+				m_parked.erase(itParked);
+				--m_parkedCount;
+			}
+		}
+
+		// the instance might still be in a run queue, it is dropped by the worker that pops it next
+		while(instance->running)
+			std::this_thread::yield();
+
+		return true;
+	}
+
+	void DSPScheduler::workerFunc(const size_t _index)
+	{
+		uint32_t slices = 0;
+
+		while(m_runThreads)
+		{
+			const uint64_t generation = m_workGeneration;
+
+			auto instance = popInstance(_index);
+
+			if(!instance)
+			{
+				if(unparkInstances(_index))
+					continue;
+
+				// anything that has been made available since we started looking changes the generation
+				std::unique_lock<std::mutex> lock(m_mutex);
+				++m_idleWorkers;
+				m_cvIdle.wait(lock, [&]
+				{
+					return !m_runThreads || m_workGeneration != generation;
+				});
+				--m_idleWorkers;
+				continue;
+			}
+
+			instance->running = true;
+
+			if(instance->removed)
+			{
+				instance->running = false;
+				continue;
+			}
+
+			if(instance->canRun && !instance->canRun(instance->dsp))
+			{
+				// parked instances might not run for a long time, do not hold back other DSPs that share the JIT code cache
+				instance->dsp.getJit().goOffline();
+
+				instance->running = false;
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if(!instance->removed)
+				{
+					m_parked.push_back(std::move(instance));
+					++m_parkedCount;
+				}
+				continue;
+			}
+
+			runSlice(*instance);
+
+			instance->running = false;
+
+			// let an idle worker steal if there is more than one instance in our queue
+			if(pushInstance(_index, std::move(instance)) > 1 && m_idleWorkers)
+				notifyWork();
+
+			// parked instances are checked by idle workers, but do not let them starve if all workers are busy
+			if((++slices & 15) == 0 && unparkInstances(_index) && m_idleWorkers)
+				notifyWork();
+		}
+	}
+
+	DSPScheduler::InstancePtr DSPScheduler::popInstance(const size_t _index)
+	{
+		InstancePtr res;
+
+		{
+			auto& w = *m_workers[_index];
+			std::lock_guard<std::mutex> lock(w.mutex);
+
+			if(!w.queue.empty())
+			{
+				res = std::move(w.queue.front());
+				w.queue.pop_front();
+				return res;
+			}
+		}
+
+		// steal from the back of another queue
+		for(size_t i=1; i<m_workers.size(); ++i)
+		{
+			auto& w = *m_workers[(_index + i) % m_workers.size()];
+			std::lock_guard<std::mutex> lock(w.mutex);
+
+			if(!w.queue.empty())
+			{
+				res = std::move(w.queue.back());
+				w.queue.pop_back();
+				return res;
+			}
+		}
+
+		return res;
+	}
+
+	size_t DSPScheduler::pushInstance(const size_t _index, InstancePtr _instance)
+	{
+		auto& w = *m_workers[_index];
+		std::lock_guard<std::mutex> lock(w.mutex);
+		w.queue.push_back(std::move(_instance));
+		return w.queue.size();
+	}
+
+	bool DSPScheduler::unparkInstances(const size_t _index)
+	{
+		if(!m_parkedCount)
+			return false;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		bool res = false;
+
+		for(auto it = m_parked.begin(); it != m_parked.end();)
+		{
+			auto& instance = *it;
+
+			if(instance->canRun(instance->dsp))
+			{
+				pushInstance(_index, std::move(instance));
+				it = m_parked.erase(it);
+				--m_parkedCount;
+				res = true;
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		return res;
+	}
+
+	void DSPScheduler::runSlice(Instance& _instance) const
+	{
+		auto& dsp = _instance.dsp;
+
+		const auto iBegin = dsp.getInstructionCounter();
+
+		dsp.exec(m_sliceInstructions);
+
+		// only one worker runs an instance at a time, which keeps the single writer rule of the telemetry
+		dsp.getTelemetry().add(TelemetryCounter::Instructions, dsp.getInstructionCounter() - iBegin);
+	}
+}
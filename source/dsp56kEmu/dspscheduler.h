@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dsp56k
+{
+	class DSP;
+
+	// Runs many DSP instances on a fixed number of worker threads instead of one spinning thread per DSP.
+	// Instances are executed in slices of a fixed number of instructions, rounded up to the end of a JIT block. Every worker has its own run queue, idle workers steal
+	// instances from other workers. Instances that cannot run, for example because they wait for audio I/O, are parked until they can
+	class DSPScheduler final
+	{
+	public:
+		// Called before a slice is executed. Return false if the instance would block, it is parked until it returns true. Parked instances are
+		// checked by busy workers from time to time, idle workers check them after wakeUp() has been called
+		using CanRunFunc = std::function<bool(DSP&)>;
+
+		explicit DSPScheduler(size_t _workerCount = 0, uint32_t _sliceInstructions = 4096);
+		~DSPScheduler();
+
+		DSPScheduler(const DSPScheduler&) = delete;
+		DSPScheduler& operator = (const DSPScheduler&) = delete;
+
+		void add(DSP& _dsp, CanRunFunc _canRun = CanRunFunc());
+
+		// Returns once the instance is no longer executed by any worker
+		bool remove(const DSP& _dsp);
+
+		// Call when a parked instance might be able to run again, for example after the host has provided audio input. Can be called from any thread
+		void wakeUp();
+
+		size_t getWorkerCount() const { return m_workers.size(); }
+
+	private:
+		struct Instance
+		{
+			explicit Instance(DSP& _dsp, CanRunFunc&& _canRun) : dsp(_dsp), canRun(std::move(_canRun)) {}
+
+			DSP& dsp;
+			CanRunFunc canRun;
+			std::atomic<bool> running{false};
+			std::atomic<bool> removed{false};
+		};
+
+		using InstancePtr = std::shared_ptr<Instance>;
+
+		struct Worker
+		{
+			std::mutex mutex;
+			std::deque<InstancePtr> queue;
+			std::thread thread;
+		};
+
+		void workerFunc(size_t _index);
+		InstancePtr popInstance(size_t _index);
+		size_t pushInstance(size_t _index, InstancePtr _instance);	// returns the new size of the queue
+		bool unparkInstances(size_t _index);
+		void runSlice(Instance& _instance) const;
+		void notifyWork();
+
+		const uint32_t m_sliceInstructions;
+
+		std::vector<std::unique_ptr<Worker>> m_workers;
+
+		std::mutex m_mutex;
+		std::vector<InstancePtr> m_instances;
+		std::vector<InstancePtr> m_parked;
+		std::atomic<size_t> m_parkedCount{0};
+		std::condition_variable m_cvIdle;
+		std::atomic<uint64_t> m_workGeneration{0};	// incremented with m_mutex held whenever idle workers might find something to do
+		std::atomic<size_t> m_idleWorkers{0};
+		std::atomic<size_t> m_nextWorker{0};
+
+		std::atomic<bool> m_runThreads{true};
+	};
+}
@@ -1,17 +1,46 @@
 #include "dspthread.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <future>
 #include <iostream>
+#include <memory>
 
 #include "dsp.h"
+#include "snapshot.h"
 
-#ifdef WIN32
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
 #endif
 
 namespace dsp56k
 {
-	DSPThread::DSPThread(DSP& _dsp): m_dsp(_dsp), m_runThread(true)
+	constexpr uint32_t g_burstInstructions = 128;	// instructions executed between two safe points
+
+	DSPThread::DSPThread(DSP& _dsp, Config _config): m_dsp(_dsp), m_config(std::move(_config)), m_runThread(true), m_statusSequence(0)
 	{
+		publishStatus();
+
+		if(m_config.logMips)
+		{
+			// formatting and printing is done by the exporter thread to keep the DSP thread free of I/O
+			m_mipsExporter.reset(new TelemetryExporter(m_dsp.getTelemetry(), std::chrono::seconds(5), [last = m_dsp.getTelemetry().read()](const Telemetry::Values& _values) mutable
+			{
+				const auto instructions = _values.get(TelemetryCounter::Instructions) - last.get(TelemetryCounter::Instructions);
+				const auto seconds = std::chrono::duration<double>(_values.time - last.time).count();
+				const auto mips = seconds > 0.0 ? static_cast<double>(instructions) / (seconds * 1000000.0) : 0.0;
+				last = _values;
+
+				char temp[64];
+				sprintf(temp, "MIPS: %.6f", mips);
+				LOG(temp);
+			}));
+		}
+
 		m_thread.reset(new std::thread([this]
 		{
 			threadFunc();
@@ -28,19 +57,312 @@ namespace dsp56k
 		if(!m_thread)
 			return;
 
-		m_runThread = false;
+		{
+			// wake up the DSP thread in case it is paused
+			std::lock_guard<std::mutex> lock(m_commandMutex);
+			m_runThread = false;
+		}
+		m_commandCv.notify_one();
 
 		m_dsp.terminate();
 
 		m_thread->join();
 		m_thread.reset();
+
+		m_mipsExporter.reset();
 	}
 
-	void DSPThread::threadFunc()
+	void DSPThread::pause()
+	{
+		pushCommand({CommandType::Pause, 0, {}});
+	}
+
+	void DSPThread::resume()
+	{
+		pushCommand({CommandType::Resume, 0, {}});
+	}
+
+	void DSPThread::step(const uint32_t _instructions/* = 1*/)
+	{
+		pushCommand({CommandType::Step, _instructions, {}});
+	}
+
+	void DSPThread::execAtSafePoint(SafePointFunc _func)
+	{
+		pushCommand({CommandType::Exec, 0, std::move(_func)});
+	}
+
+	void DSPThread::execAtSafePointBlocking(const SafePointFunc& _func)
+	{
+		if(!m_thread)
+		{
+			_func(m_dsp);
+			return;
+		}
+
+		assert(std::this_thread::get_id() != m_thread->get_id() && "must not be called from the DSP thread");
+
+		// the promise is owned by the command. If the command is discarded on shutdown, the promise is broken and the wait returns
+		auto done = std::make_shared<std::promise<void>>();
+		auto future = done->get_future();
+
+		execAtSafePoint([&_func, done](DSP& _dsp)
+		{
+			_func(_dsp);
+			done->set_value();
+		});
+
+		future.wait();
+	}
+
+	bool DSPThread::createSnapshot(Snapshot& _snapshot)
+	{
+		bool res = false;
+
+		execAtSafePointBlocking([&](DSP& _dsp)
+		{
+			res = _snapshot.create(_dsp);
+		});
+
+		return res;
+	}
+
+	bool DSPThread::restoreSnapshot(const Snapshot& _snapshot)
+	{
+		bool res = false;
+
+		execAtSafePointBlocking([&](DSP& _dsp)
+		{
+			res = _snapshot.restore(_dsp);
+		});
+
+		return res;
+	}
+
+	DSPThread::Status DSPThread::getStatus() const
+	{
+		while(true)
+		{
+			const auto seq = m_statusSequence.load(std::memory_order_acquire);
+
+			if(seq & 1)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			const Status s = m_status;
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if(m_statusSequence.load(std::memory_order_relaxed) == seq)
+				return s;
+		}
+	}
+
+	void DSPThread::pushCommand(Command&& _command)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_commandMutex);
+
+			// wait for space without holding the lock, the DSP thread needs it to wake up if it is paused
+			while(m_runThread && m_commands.full())
+			{
+				lock.unlock();
+				m_commandCv.notify_one();
+				m_commands.waitNotFull();
+				lock.lock();
+			}
+
+			// the DSP thread is shutting down and will not process commands anymore
+			if(!m_runThread)
+				return;
+
+			m_commands.push_back(std::move(_command));
+		}
+		m_commandCv.notify_one();
+
+		// the DSP might be waiting for host input in an idle loop
+		m_dsp.wakeUp();
+	}
+
+	void DSPThread::processCommands()
+	{
+		while(true)
+		{
+			while(!m_commands.empty())
+			{
+				const Command c = m_commands.pop_front();
+
+				switch (c.type)
+				{
+				case CommandType::Pause:	m_paused = true;			break;
+				case CommandType::Resume:	m_paused = false;			break;
+				case CommandType::Step:		m_pendingSteps += c.param;	break;
+				case CommandType::Exec:
+					// the function sees the effect of all commands that were pushed before it, including the published status
+					execPendingSteps();
+					publishStatus();
+					c.func(m_dsp);
+					break;
+				}
+			}
+
+			execPendingSteps();
+			publishStatus();
+
+			if(!m_paused || !m_runThread)
+				return;
+
+			// we might be paused for a long time, do not hold back other DSPs that share the JIT code cache
+			m_dsp.getJit().goOffline();
+
+			std::unique_lock<std::mutex> lock(m_commandMutex);
+			m_commandCv.wait(lock, [this]
+			{
+				return !m_commands.empty() || !m_runThread;
+			});
+		}
+	}
+
+	void DSPThread::execPendingSteps()
+	{
+		if(!m_pendingSteps)
+			return;
+
+		const auto iBegin = m_dsp.getInstructionCounter();
+
+		m_dsp.exec(m_pendingSteps);
+
+		m_pendingSteps = 0;
+		m_instructions += m_dsp.getInstructionCounter() - iBegin;
+	}
+
+	void DSPThread::publishStatus()
+	{
+		const auto seq = m_statusSequence.load(std::memory_order_relaxed);
+
+		m_statusSequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		const auto& regs = m_dsp.readRegs();
+
+		m_status.instructions = m_instructions;
+		m_status.pc = regs.pc.var;
+		m_status.sr = regs.sr.var;
+		m_status.omr = regs.omr.var;
+		m_status.sp = regs.sp.var;
+		m_status.sc = regs.sc.var;
+		m_status.processingMode = m_dsp.getProcessingMode();
+		m_status.paused = m_paused;
+
+		m_statusSequence.store(seq + 2, std::memory_order_release);
+	}
+
+	void DSPThread::applyConfig() const
 	{
 #ifdef _WIN32
 		::SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+		if(!m_config.cpuAffinity.empty())
+		{
+			DWORD_PTR mask = 0;
+			for (const auto cpu : m_config.cpuAffinity)
+			{
+				if(cpu >= sizeof(DWORD_PTR) * 8)
+				{
+					LOG("Ignoring DSP thread affinity CPU " << cpu << ", the affinity mask supports CPUs 0-" << (sizeof(DWORD_PTR) * 8 - 1));
+					continue;
+				}
+				mask |= static_cast<DWORD_PTR>(1) << cpu;
+			}
+
+			if(!mask)
+				LOG("No valid CPU in DSP thread affinity, keeping the current affinity");
+			else if(!::SetThreadAffinityMask(GetCurrentThread(), mask))
+				LOG("Failed to set DSP thread affinity, error " << GetLastError());
+		}
+
+		if(m_config.memoryLock != Config::MemoryLock::None)
+			LOG("Memory locking is not supported on this platform");
+#else
+		if(m_config.scheduling != Config::Scheduling::Default)
+		{
+			const int policy = m_config.scheduling == Config::Scheduling::Fifo ? SCHED_FIFO : SCHED_RR;
+
+			const int prioMin = sched_get_priority_min(policy);
+			const int prioMax = sched_get_priority_max(policy);
+
+			sched_param param{};
+			int currentPolicy = 0;
+			if(m_config.priority > 0)
+				param.sched_priority = m_config.priority;
+			else if(pthread_getschedparam(pthread_self(), &currentPolicy, &param))
+				param.sched_priority = prioMin;
+			param.sched_priority = std::min(std::max(param.sched_priority, prioMin), prioMax);
+
+			const auto err = pthread_setschedparam(pthread_self(), policy, &param);
+			if(err)
+				LOG("Failed to set real-time scheduling for DSP thread, priority " << param.sched_priority << ", error " << err << ". Missing privileges? Running with default scheduling");
+		}
+
+		if(!m_config.cpuAffinity.empty())
+		{
+#ifdef __linux__
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			for (const auto cpu : m_config.cpuAffinity)
+			{
+				if(cpu >= CPU_SETSIZE)
+				{
+					LOG("Ignoring DSP thread affinity CPU " << cpu << ", CPU_SETSIZE is " << CPU_SETSIZE);
+					continue;
+				}
+				CPU_SET(cpu, &cpus);
+			}
+
+			if(!CPU_COUNT(&cpus))
+			{
+				LOG("No valid CPU in DSP thread affinity, keeping the current affinity");
+			}
+			else
+			{
+				const auto err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+				if(err)
+					LOG("Failed to set DSP thread affinity, error " << err);
+			}
+#else
+			LOG("Setting the DSP thread affinity is not supported on this platform");
+#endif
+		}
+
+		switch (m_config.memoryLock)
+		{
+		case Config::MemoryLock::None:
+			break;
+		case Config::MemoryLock::DspMemory:
+			{
+				auto& mem = m_dsp.memory();
+				for(size_t a=0; a<MemArea_COUNT; ++a)
+				{
+					const auto area = static_cast<EMemArea>(a);
+					if(mlock(mem.getMemAreaPtr(area), mem.size(area) * sizeof(TWord)))
+						LOG("Failed to lock DSP memory pages, error " << errno << ". Missing privileges or RLIMIT_MEMLOCK too low?");
+				}
+			}
+			break;
+		case Config::MemoryLock::All:
+			if(mlockall(MCL_CURRENT | MCL_FUTURE))
+				LOG("Failed to lock process memory, error " << errno << ". Missing privileges or RLIMIT_MEMLOCK too low?");
+			break;
+		}
 #endif
+	}
+
+	void DSPThread::threadFunc()
+	{
+		applyConfig();
+
 		size_t instructions = 0;
 		size_t counter = 0;
 
@@ -55,26 +377,26 @@ namespace dsp56k
 #endif
 		while(m_runThread)
 		{
+			// safe point. No lock is taken unless there is something to do
+			if(!m_commands.empty() || m_paused)
 			{
-				Guard g(m_mutex);
+				processCommands();
 
-				const auto iBegin = m_dsp.getInstructionCounter();
+				if(!m_runThread)
+					break;
+			}
 
-				for(size_t i=0; i<128; i += 8)
-				{
-					m_dsp.exec();
-					m_dsp.exec();
-					m_dsp.exec();
-					m_dsp.exec();
-					m_dsp.exec();
-					m_dsp.exec();
-					m_dsp.exec();
-					m_dsp.exec();
-				}
+			const auto iBegin = m_dsp.getInstructionCounter();
 
-				instructions += m_dsp.getInstructionCounter() - iBegin;
-				counter += 128;
-			}
+			m_dsp.exec(g_burstInstructions);
+
+			const auto executed = m_dsp.getInstructionCounter() - iBegin;
+			instructions += executed;
+			m_instructions += executed;
+			m_dsp.getTelemetry().add(TelemetryCounter::Instructions, executed);
+			counter += g_burstInstructions;
+
+			publishStatus();
 
 			if((counter & (ipsStep-1)) == 0)
 			{
@@ -83,16 +405,17 @@ namespace dsp56k
 
 				const auto ms = std::chrono::duration_cast<std::chrono::microseconds>(d);
 
-				const auto ips = static_cast<double>(instructions) / static_cast<double>(ms.count());
+				if(ms.count() > 0)
+					m_dsp.getTelemetry().record(TelemetryHistogram::KiloInstructionsPerSecond, instructions * 1000 / ms.count());
 
 				instructions = 0;
 				t = t2;
-
-				char temp[64];
-				sprintf(temp, "MIPS: %.6f", ips);
-				puts(temp);
-				LOG(temp);
 			}
 		}
+
+		// discard what has not been processed, this fails the promises of blocking callers
+		std::lock_guard<std::mutex> lock(m_commandMutex);
+		while(!m_commands.empty())
+			m_commands.pop_front();
 	}
 }
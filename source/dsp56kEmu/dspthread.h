@@ -1,29 +1,127 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "dsp.h"
+#include "ringbuffer.h"
+#include "telemetry.h"
 
 namespace dsp56k
 {
 	class DSP;
+	class Snapshot;
+
+	// Real-time configuration of the DSP thread. Everything is optional, settings that cannot be applied, for example because of missing
+	// privileges, are logged and ignored
+	struct DSPThreadConfig
+	{
+		enum class Scheduling
+		{
+			Default,		// Windows: THREAD_PRIORITY_TIME_CRITICAL, otherwise the default scheduler of the OS
+			Fifo,			// SCHED_FIFO
+			RoundRobin		// SCHED_RR
+		};
+
+		enum class MemoryLock
+		{
+			None,
+			DspMemory,		// lock the pages of the DSP memory. Commits all pages of sparse memory. JIT code is not locked, use All for that
+			All				// lock all current and future pages of the process
+		};
+
+		Scheduling scheduling = Scheduling::Default;
+		int priority = 0;					// real-time priority for Fifo/RoundRobin, clamped to the valid range. 0 = keep the current priority of the thread
+		std::vector<uint32_t> cpuAffinity;	// list of CPUs the thread may run on, empty = no restriction. CPUs beyond the platform limit (64 on Windows, CPU_SETSIZE on Linux) are ignored
+		MemoryLock memoryLock = MemoryLock::None;
+		bool logMips = true;					// periodically log the execution speed from a background thread
+	};
 
 	class DSPThread final
 	{
 	public:
-		using Guard = std::lock_guard<std::mutex>;
+		// Published by the DSP thread after every execution burst, can be read at any time without blocking the DSP thread
+		struct Status
+		{
+			uint64_t instructions = 0;
+			TWord pc = 0;
+			TWord sr = 0;
+			TWord omr = 0;
+			TWord sp = 0;
+			TWord sc = 0;
+			DSP::ProcessingMode processingMode = DSP::Default;
+			bool paused = false;
+		};
+
+		using Config = DSPThreadConfig;
+
+		using SafePointFunc = std::function<void(DSP&)>;
 
-		explicit DSPThread(DSP& _dsp);
+		explicit DSPThread(DSP& _dsp, Config _config = Config());
 		~DSPThread();
 		void join();
-		std::mutex& mutex() { return m_mutex; }
+
+		// Commands are executed by the DSP thread at the next safe point, which is between two execution bursts. Commands that are still pending when
+		// the thread is terminated are discarded
+		void pause();
+		void resume();
+		// runs at least _instructions instructions, under the JIT the last block is always run to its end
+		void step(uint32_t _instructions = 1);
+		void execAtSafePoint(SafePointFunc _func);
+
+		// same as execAtSafePoint but blocks until the function has been executed. Returns without executing it if the thread is terminated first
+		void execAtSafePointBlocking(const SafePointFunc& _func);
+
+		bool createSnapshot(Snapshot& _snapshot);
+		bool restoreSnapshot(const Snapshot& _snapshot);
+
+		Status getStatus() const;
 
 	private:
+		enum class CommandType
+		{
+			Pause,
+			Resume,
+			Step,
+			Exec
+		};
+
+		struct Command
+		{
+			CommandType type = CommandType::Exec;
+			uint32_t param = 0;
+			SafePointFunc func;
+		};
+
 		void threadFunc();
+		void applyConfig() const;
+		void pushCommand(Command&& _command);
+		void processCommands();
+		void execPendingSteps();
+		void publishStatus();
 
 		DSP& m_dsp;
+		const Config m_config;
 
-		std::mutex m_mutex;
 		std::unique_ptr<std::thread> m_thread;
+		std::unique_ptr<TelemetryExporter> m_mipsExporter;
 
 		std::atomic<bool> m_runThread;
+
+		// Multiple producers are serialized by the mutex, the DSP thread only consumes. It never locks unless a command is pending or it is paused
+		RingBuffer<Command, 64, false> m_commands;
+		std::mutex m_commandMutex;
+		std::condition_variable m_commandCv;
+		bool m_paused = false;
+		uint32_t m_pendingSteps = 0;
+
+		// status, published via a sequence lock. The sequence is odd while the status is being written
+		std::atomic<uint32_t> m_statusSequence;
+		Status m_status;
+		uint64_t m_instructions = 0;
 	};
 }
@@ -3,6 +3,7 @@
 #include "dsp.h"
 #include "interrupts.h"
 #include "peripherals.h"
+#include "snapshot.h"
 
 namespace dsp56k
 {
@@ -28,7 +29,14 @@ namespace dsp56k
 		// Time to xfer samples!
 		m_cyclesSinceWrite -= m_cyclesPerSample;
 		for (int i=0;i<3;i++) if (outputEnabled(i)) writeTXimpl(i,m_tx[i]);
-		for (int i=0;i<1;i++) if (inputEnabled(i)) m_rx[i]=readRXimpl(i);
+		for (int i=0;i<1;i++)
+		{
+			if (!inputEnabled(i))
+				continue;
+			if (m_audioInputs[i].empty())
+				m_periph.getDSP().getTelemetry().add(TelemetryCounter::AudioUnderruns);
+			m_rx[i]=readRXimpl(i);
+		}
 		if (m_sr.test(M_TFS)) m_sr.clear(M_TFS); else m_sr.set(M_TFS);
 
 //		if (m_sr.test(M_TUE) && m_tcr.test(M_TEIE)) m_periph.getDSP().injectInterrupt(Vba_ESAI_Transmit_Data_with_Exception_Status);
@@ -41,6 +49,20 @@ namespace dsp56k
 		m_hasReadStatus = 0;
 	}
 
+	TWord Esai::getInstructionsUntilNextEvent() const
+	{
+		if(!(m_tcr & M_TEM))
+			return 0;
+
+		const auto clock = m_periph.getDSP().getInstructionCounter();
+		const auto cycles = m_cyclesSinceWrite + delta(clock, m_lastClock);
+
+		if(cycles >= m_cyclesPerSample)
+			return 1;
+
+		return m_cyclesPerSample + 1 - cycles;
+	}
+
 	void Esai::updatePCTL(TWord _val)
 	{
 		const TWord pctl = _val;
@@ -52,8 +74,7 @@ namespace dsp56k
 		// dsp_frequency = m_extClock * mf / pd    and   samplerate = m_extClock/256
 
 		const float speed_mhz = 12.0f * mf / pd;
-		LOG("Clock speed changed to: " << speed_mhz << "Mhz, pd=" << HEX(pd) << ", mf=" << HEX(mf) << ", word=" << HEX(
-			_val)); // logging assumes an external crystal at 12MHz
+		LOGB_INFO("Clock speed changed to: %fMhz, pd=%06x, mf=%06x, word=%06x", speed_mhz, pd, mf, _val); // logging assumes an external crystal at 12MHz
 	}
 
 	void Esai::writeTX(uint32_t _index, TWord _val)
@@ -85,4 +106,42 @@ namespace dsp56k
 				m_audioInputs[i].push_back(0);
 		}
 	}
+
+	void Esai::saveState(SnapshotWriter& _writer) const
+	{
+		Audio::saveState(_writer);
+
+		_writer.write(m_sr);
+		_writer.write(m_cr);
+		_writer.write(m_tcr);
+		_writer.write(m_rcr);
+		_writer.write(m_rccr);
+		_writer.write(m_tccr);
+		_writer.write(m_tx);
+		_writer.write(m_rx);
+		_writer.write(m_hasReadStatus);
+		_writer.write(m_cyclesSinceWrite);
+		_writer.write(m_writtenTX);
+		_writer.write(m_lastClock);
+		_writer.write(m_cyclesPerSample);
+	}
+
+	bool Esai::loadState(SnapshotReader& _reader)
+	{
+		Audio::loadState(_reader);
+
+		_reader.read(m_sr);
+		_reader.read(m_cr);
+		_reader.read(m_tcr);
+		_reader.read(m_rcr);
+		_reader.read(m_rccr);
+		_reader.read(m_tccr);
+		_reader.read(m_tx);
+		_reader.read(m_rx);
+		_reader.read(m_hasReadStatus);
+		_reader.read(m_cyclesSinceWrite);
+		_reader.read(m_writtenTX);
+		_reader.read(m_lastClock);
+		return _reader.read(m_cyclesPerSample);
+	}
 }
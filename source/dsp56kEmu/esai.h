@@ -233,6 +233,9 @@ namespace dsp56k
 		explicit Esai(IPeripherals& _periph);
 
 		void exec();
+
+		// instructions until the next frame is transferred, 0 if the transmitter is disabled
+		TWord getInstructionsUntilNextEvent() const;
 		
 		TWord readStatusRegister()
 		{
@@ -293,6 +296,9 @@ namespace dsp56k
 
 		void terminate();
 
+		void saveState(SnapshotWriter& _writer) const;
+		bool loadState(SnapshotReader& _reader);
+
 	private:
 		bool inputEnabled(uint32_t _index) const	{ return m_rcr.test(static_cast<RcrBits>(_index)); }
 		bool outputEnabled(uint32_t _index) const	{ return m_tcr.test(static_cast<TcrBits>(_index)); }
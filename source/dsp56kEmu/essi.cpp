@@ -4,6 +4,7 @@
 #include "memory.h"
 #include "interrupts.h"
 #include "dsp.h"
+#include "snapshot.h"
 
 namespace dsp56k
 {
@@ -42,6 +43,9 @@ namespace dsp56k
 		if(!bittest(get(Essi0, ESSI0_CRB), CRB_RE))
 			return 0;
 
+		if(m_audioInputs[_index].empty())
+			m_periph.getDSP().getTelemetry().add(TelemetryCounter::AudioUnderruns);
+
 		const auto res = readRXimpl(_index);
 
 		toggleStatusRegisterBit(Essi0, SSISR_RFS, m_frameSyncDSPRead);
@@ -87,4 +91,16 @@ namespace dsp56k
 	{
 		return m_periph.read(address(_index, _reg), Nop);
 	}
+
+	void Essi::saveState(SnapshotWriter& _writer) const
+	{
+		Audio::saveState(_writer);
+		_writer.write(m_statusReg);
+	}
+
+	bool Essi::loadState(SnapshotReader& _reader)
+	{
+		Audio::loadState(_reader);
+		return _reader.read(m_statusReg);
+	}
 };
@@ -165,6 +165,9 @@ namespace dsp56k
 		void writeSR(TWord _sr) { m_statusReg = _sr; }
 
 		void writeTX(uint32_t _txIndex, TWord _val);
+
+		void saveState(SnapshotWriter& _writer) const;
+		bool loadState(SnapshotReader& _reader);
 		
 	private:
 		void reset(EssiIndex _index);
@@ -1,6 +1,7 @@
 #include "dsp.h"
 #include "interrupts.h"
 #include "hdi08.h"
+#include "snapshot.h"
 
 namespace dsp56k
 {
@@ -25,7 +26,7 @@ namespace dsp56k
 	{
 		if (m_data.empty())
 		{
-			LOG("Empty read");
+			LOGB_WARNING("Empty read");
 			return 0;
 		}
 
@@ -58,6 +59,8 @@ namespace dsp56k
 				++m_pendingRXInterrupts;
 			}
 		}
+
+		wakeUp();
 	}
 
 	void HDI08::clearRX()
@@ -70,6 +73,8 @@ namespace dsp56k
 		dsp56k::bitset<TWord, HSR_HF0>(m_hsr, _flag0);
 		dsp56k::bitset<TWord, HSR_HF1>(m_hsr, _flag1);
 		LOG("Write HostFlags, HSR " << HEX(m_hsr));
+
+		wakeUp();
 	}
 
 	bool HDI08::dataRXFull() const
@@ -81,6 +86,31 @@ namespace dsp56k
 	{
 		while(!m_data.full())
 			m_data.push_back(0);
+
+		wakeUp();
+	}
+
+	bool HDI08::waitForInput(const std::chrono::microseconds _timeout)
+	{
+		if(!bittest(m_hpcr, HPCR_HEN))
+			return false;
+
+		std::unique_lock<std::mutex> lock(m_inputMutex);
+
+		if(m_data.empty())
+			m_inputCv.wait_for(lock, _timeout, [this] { return m_hasInput; });
+
+		m_hasInput = false;
+		return true;
+	}
+
+	void HDI08::wakeUp()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_inputMutex);
+			m_hasInput = true;
+		}
+		m_inputCv.notify_one();
 	}
 
 	bool HDI08::hasTX() const
@@ -107,4 +137,33 @@ namespace dsp56k
 		//LOG("Write HDI08 HCR " << HEX(_val));
 		m_hcr = _val;
 	}
+
+	void HDI08::saveState(SnapshotWriter& _writer)
+	{
+		_writer.write(m_hsr);
+		_writer.write(m_hcr);
+		_writer.write(m_hpcr);
+		_writer.write(m_data);
+		_writer.write(m_dataTX);
+		_writer.write(m_pendingRXInterrupts.load());
+		_writer.write(m_pendingTXInterrupts.load());
+	}
+
+	bool HDI08::loadState(SnapshotReader& _reader)
+	{
+		_reader.read(m_hsr);
+		_reader.read(m_hcr);
+		_reader.read(m_hpcr);
+		_reader.read(m_data);
+		_reader.read(m_dataTX);
+
+		uint32_t pendingRX = 0, pendingTX = 0;
+		_reader.read(pendingRX);
+		if(!_reader.read(pendingTX))
+			return false;
+
+		m_pendingRXInterrupts = pendingRX;
+		m_pendingTXInterrupts = pendingTX;
+		return true;
+	}
 };
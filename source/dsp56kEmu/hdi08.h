@@ -1,5 +1,8 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
 
 #include "opcodetypes.h"
@@ -7,6 +10,9 @@
 namespace dsp56k
 {
 	class IPeripherals;
+	class SnapshotReader;
+	class SnapshotWriter;
+
 	class HDI08
 	{
 	public:
@@ -66,13 +72,13 @@ namespace dsp56k
 
 		void writeStatusRegister(const TWord _val)
 		{
-			LOG("Write HDI08 HSR " << HEX(_val));
+			LOGB_INFO("Write HDI08 HSR %06x", _val);
 			m_hsr = _val;
 		}
 
 		void writePortControlRegister(const TWord _val)
 		{
-			LOG("Write HDI08 HPCR " << HEX(_val));
+			LOGB_INFO("Write HDI08 HPCR %06x", _val);
 			m_hpcr = _val;
 		}
 
@@ -98,6 +104,15 @@ namespace dsp56k
 
 		void terminate();
 
+		// blocks until the host writes data or changes the host flags, or until the timeout expired. Returns false immediately if the host interface is disabled
+		bool waitForInput(std::chrono::microseconds _timeout);
+
+		// makes a running or the next call to waitForInput() return
+		void wakeUp();
+
+		void saveState(SnapshotWriter& _writer);
+		bool loadState(SnapshotReader& _reader);
+
 	private:
 		TWord m_hsr = 0;
 		TWord m_hcr = 0;
@@ -107,5 +122,9 @@ namespace dsp56k
 		IPeripherals& m_periph;
 		std::atomic<uint32_t> m_pendingRXInterrupts;
 		std::atomic<uint32_t> m_pendingTXInterrupts;
+
+		std::mutex m_inputMutex;
+		std::condition_variable m_inputCv;
+		bool m_hasInput = false;
 	};
 }
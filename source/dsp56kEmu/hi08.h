@@ -1,5 +1,7 @@
 #pragma once
 
+#include "snapshot.h"
+
 namespace dsp56k
 {
 	class HI08
@@ -48,6 +50,18 @@ namespace dsp56k
 		
 		void reset() {}
 
+		void saveState(SnapshotWriter& _writer)
+		{
+			_writer.write(m_hsr);
+			_writer.write(m_data);
+		}
+
+		bool loadState(SnapshotReader& _reader)
+		{
+			_reader.read(m_hsr);
+			return _reader.read(m_data);
+		}
+
 	private:
 		TWord m_hsr = 0;
 		RingBuffer<uint32_t, 1024, false> m_data;
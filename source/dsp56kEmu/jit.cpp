@@ -1,9 +1,16 @@
 #include "jit.h"
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <typeinfo>
+
 #include "dsp.h"
 #include "jitblock.h"
+#include "jitcodecache.h"
 #include "jithelper.h"
 #include "jitops.h"
+#include "programanalysis.h"
 
 #include "asmjit/core/jitruntime.h"
 
@@ -17,6 +24,8 @@ namespace dsp56k
 {
 	constexpr bool g_traceOps = false;
 
+	using Lock = std::lock_guard<std::recursive_mutex>;
+
 	void funcCreate(Jit* _jit, const TWord _pc)
 	{
 		_jit->create(_pc, true);
@@ -37,44 +46,179 @@ namespace dsp56k
 		_jit->run(_pc);
 	}
 
-	Jit::Jit(DSP& _dsp) : m_dsp(_dsp)
+	Jit::Jit(DSP& _dsp) : m_dsp(_dsp), m_quiescentEpoch(g_jitRetireEpoch.load())
 	{
-		m_jitCache.resize(_dsp.memory().size());
-		m_jitFuncs.resize(_dsp.memory().size(), &funcCreate);
-
-		m_rt = new JitRuntime();
+		updateMemoryPointers();
+		setCodeCache(std::make_shared<JitCodeCache>(_dsp.memory().size()));
 	}
 
 	Jit::~Jit()
 	{
-		for(size_t i=0; i<m_jitCache.size(); ++i)
-		{
-			auto& e = m_jitCache[i];
+		releaseDetachedCaches();
+		removeUser(*m_cache);
+	}
 
-			if(e.block)
-				destroy(e.block);
+	void Jit::goOffline()
+	{
+		if(m_offline)
+			return;
+
+		m_offline = true;
+
+		// the highest possible epoch, we do not hold back any retired block
+		m_quiescentEpoch.store(std::numeric_limits<uint64_t>::max(), std::memory_order_release);
+
+		releaseDetachedCaches();
+
+		// blocks might have been waiting for us only
+		const Lock lock(m_cache->m_mutex);
+		m_cache->reclaimRetiredBlocks();
+	}
+
+	void Jit::goOnline()
+	{
+		// Published under the lock that blocks are retired with. A block that has been retired before is no longer in the lookup tables
+		// that we read next, one that is retired afterwards waits for us to return to the dispatcher
+		const Lock lock(m_cache->m_mutex);
+		m_quiescentEpoch.store(g_jitRetireEpoch.load(std::memory_order_acquire), std::memory_order_release);
+		m_offline = false;
+	}
+
+	void Jit::notifyProgramMemWrite(const TWord _offset)
+	{
+		const Lock lock(m_cache->m_mutex);
+		destroy(_offset);
+	}
+
+	void Jit::notifyProgramMemWrite(const TWord _offset, const TWord _count)
+	{
+		const Lock lock(m_cache->m_mutex);
+
+		for(TWord i=0; i<_count; ++i)
+			destroy(_offset + i);
+	}
+
+	void Jit::notifyProgramMemorySharingChanged()
+	{
+		// Might be called from dspWrite while JIT code is running, if a write detaches the shared P image. The running code belongs to the old cache, which
+		// stays alive in m_detachedCaches until we are back in the dispatcher and is not modified. It has been generated for a shared image and writes all memory via dspWrite
+		updateMemoryPointers();
+
+		// Existing code has been generated for a different P memory and with different memory write handling, start from scratch
+		detachCodeCache();
+	}
+
+	void Jit::notifyPeripheralsChanged()
+	{
+		updateMemoryPointers();
+
+		// Existing code might access peripheral registers directly that need a call with the new peripherals
+		detachCodeCache();
+	}
+
+	void Jit::detachCodeCache()
+	{
+		// The old cache is kept alive as we might have been called from code that is still running
+		m_detachedCaches.push_back(std::move(m_cache));
+		setCodeCache(std::make_shared<JitCodeCache>(m_dsp.memory().size()));
+	}
+
+	void Jit::releaseDetachedCaches()
+	{
+		for(const auto& cache : m_detachedCaches)
+			removeUser(*cache);
+
+		m_detachedCaches.clear();
+	}
+
+	void Jit::removeUser(JitCodeCache& _cache) const
+	{
+		const Lock lock(_cache.m_mutex);
+
+		auto& users = _cache.m_users;
+		users.erase(std::remove(users.begin(), users.end(), &m_quiescentEpoch), users.end());
+
+		// blocks might have been waiting for us only
+		_cache.reclaimRetiredBlocks();
+	}
+
+	bool Jit::shareCodeCache(Jit& _other)
+	{
+		const auto& mem = m_dsp.memory();
+		const auto& otherMem = _other.m_dsp.memory();
+
+		if(!mem.isProgramMemoryShared() || mem.getSharedProgramMemory() != otherMem.getSharedProgramMemory() ||
+			mem.size() != otherMem.size() || mem.stride() != otherMem.stride() || mem.getBridgedMemoryAddress() != otherMem.getBridgedMemoryAddress())
+		{
+			LOG("Unable to share JIT code, both DSPs need to use the same shared P memory image and the same memory layout");
+			return false;
+		}
 
-			for(auto it = e.singleOpCache.begin(); it != e.singleOpCache.end(); ++it)
+		// peripheral registers are accessed directly or via calls depending on the peripheral type
+		for(size_t i=0; i<2; ++i)
+		{
+			if(typeid(*m_dsp.getPeriph(i)) != typeid(*_other.m_dsp.getPeriph(i)))
 			{
-				release(it->second);
+				LOG("Unable to share JIT code, both DSPs need to use the same type of peripherals");
+				return false;
 			}
-			e.singleOpCache.clear();
 		}
 
-		m_jitCache.clear();
+		{
+			const Lock lock(_other.m_cache->m_mutex);
+			_other.m_cache->m_shared = true;
+		}
 
-		delete m_rt;
+		m_detachedCaches.push_back(std::move(m_cache));
+		setCodeCache(_other.m_cache);
+		return true;
+	}
+
+	bool Jit::isCodeCacheShared() const
+	{
+		return m_cache->m_shared;
+	}
+
+	void Jit::setCodeCache(std::shared_ptr<JitCodeCache> _cache)
+	{
+		m_cache = std::move(_cache);
+		m_jitFuncs = m_cache->m_jitFuncs.data();
+
+		// m_quiescentEpoch is left as is, it is still valid for the caches that we were called from
+		const Lock lock(m_cache->m_mutex);
+		m_cache->m_users.push_back(&m_quiescentEpoch);
+	}
+
+	void Jit::updateMemoryPointers()
+	{
+		auto& mem = m_dsp.memory();
+
+		for(size_t i=0; i<MemArea_COUNT; ++i)
+			m_runtimeData.m_memAreaPtrs[i] = mem.getMemAreaPtr(static_cast<EMemArea>(i));
+
+		for(size_t i=0; i<m_runtimeData.m_periphStoragePtrs.size(); ++i)
+			m_runtimeData.m_periphStoragePtrs[i] = m_dsp.getPeriph(i)->getRegisterStorage();
 	}
 
 	void Jit::emit(const TWord _pc)
 	{
+		using Clock = std::chrono::steady_clock;
+
+		auto elapsedNs = [](const Clock::time_point& _begin, const Clock::time_point& _end)
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(_end - _begin).count());
+		};
+
+		const auto tBegin = Clock::now();
+		const auto nestedBegin = m_nestedEmitNs;
+
 		AsmJitLogger logger;
 		logger.addFlags(asmjit::FormatFlags::kHexImms | /*asmjit::FormatFlags::kHexOffsets |*/ asmjit::FormatFlags::kMachineCode);
 		AsmJitErrorHandler errorHandler;
 		CodeHolder code;
 
 		code.setErrorHandler(&errorHandler);
-		code.init(m_rt->environment());
+		code.init(m_cache->m_rt->environment());
 
 		JitEmitter m_asm(&code);
 
@@ -84,25 +228,33 @@ namespace dsp56k
 		
 		auto* b = new JitBlock(m_asm, m_dsp, m_runtimeData);
 
-		m_generatingBlocks.insert(std::make_pair(_pc, b));
+		m_cache->m_generatingBlocks.insert(std::make_pair(_pc, b));
 
-		if(!b->emit(this, _pc, m_jitCache, m_volatileP))
+		if(!b->emit(this, _pc, m_cache->m_jitCache, m_cache->m_volatileP))
 		{
 			LOG("FATAL: code generation failed for PC " << HEX(_pc));
 			delete b;
-			m_generatingBlocks.erase(_pc);
+			m_cache->m_generatingBlocks.erase(_pc);
 			return;
 		}
 
-		m_generatingBlocks.erase(_pc);
+		m_cache->m_generatingBlocks.erase(_pc);
 
 		m_asm.ret();
 
+		const auto tEmit = Clock::now();
+
+		uint64_t nodeCount = 0;
+		for(const auto* n = m_asm.firstNode(); n; n = n->next())
+			++nodeCount;
+
 		m_asm.finalize();
 
+		const auto tFinalize = Clock::now();
+
 		TJitFunc func;
 
-		const auto err = m_rt->add(&func, &code);
+		const auto err = m_cache->m_rt->add(&func, &code);
 
 		if(err)
 		{
@@ -112,12 +264,35 @@ namespace dsp56k
 		}
 
 		b->setFunc(func, code.codeSize());
-		m_codeSize += code.codeSize();
+		m_cache->m_codeSize += code.codeSize();
 
 //		LOG("Total code size now " << (m_codeSize >> 10) << "kb");
 
 		occupyArea(b);
 
+		const auto tEnd = Clock::now();
+
+		// child blocks that have been compiled while emitting this one have already been accounted for
+		const auto nestedNs = m_nestedEmitNs - nestedBegin;
+		const auto compileTime = elapsedNs(tBegin, tEnd) - nestedNs;
+		m_nestedEmitNs = nestedBegin + elapsedNs(tBegin, tEnd);
+
+		auto& stats = m_compileStats;
+		++stats.blocks;
+		stats.instructions += b->getEncodedInstructionCount();
+		stats.nodes += nodeCount;
+		stats.codeBytes += code.codeSize();
+		stats.spillsToXmm += b->dspRegPool().getSpillsToXmm();
+		stats.spillsToMemory += b->dspRegPool().getSpillsToMemory();
+		stats.emitNs += elapsedNs(tBegin, tEmit) - nestedNs;
+		stats.finalizeNs += elapsedNs(tEmit, tFinalize);
+		stats.addNs += elapsedNs(tFinalize, tEnd);
+
+		auto& telemetry = m_dsp.getTelemetry();
+		telemetry.add(TelemetryCounter::JitBlocksCompiled);
+		telemetry.add(TelemetryCounter::JitCompileTimeNs, compileTime);
+		telemetry.record(TelemetryHistogram::JitCompileTimeUs, compileTime / 1000);
+
 #ifdef DSP56K_USE_VTUNE_JIT_PROFILING_API
 		if(iJIT_IsProfilingActive() == iJIT_SAMPLING_ON)
 		{
@@ -146,7 +321,7 @@ namespace dsp56k
 	{
 		for (const auto parent : _block->getParents())
 		{
-			auto& e = m_jitCache[parent];
+			auto& e = m_cache->m_jitCache[parent];
 
 			if (e.block)
 				destroy(e.block);
@@ -180,14 +355,14 @@ namespace dsp56k
 
 		for(auto i=first; i<last; ++i)
 		{
-			m_jitCache[i].block = nullptr;
+			m_cache->m_jitCache[i].block = nullptr;
 			m_jitFuncs[i] = &funcCreate;
 		}
 
 		if(_block->getPMemSize() == 1)
 		{
 			// if a 1-word-op, cache it
-			auto& cacheEntry = m_jitCache[first];
+			auto& cacheEntry = m_cache->m_jitCache[first];
 			const auto op = _block->getSingleOpWord();
 
 			if(cacheEntry.singleOpCache.find(op) == cacheEntry.singleOpCache.end())
@@ -202,12 +377,23 @@ namespace dsp56k
 		release(_block);
 	}
 
+	void Jit::destroy(const TWord _pc)
+	{
+		const auto block = m_cache->m_jitCache[_pc].block;
+		if (block)
+			destroy(block);
+	}
+
 	void Jit::release(const JitBlock* _block)
 	{
-		assert(m_codeSize >= _block->codeSize());
-		m_codeSize -= _block->codeSize();
-		m_rt->release(_block->getFunc());
-		delete _block;
+		if(m_cache->m_shared)
+		{
+			// another DSP might be running this code right now
+			m_cache->retire(_block);
+			return;
+		}
+
+		m_cache->release(_block);
 
 //		LOG("Total code size now " << (m_codeSize >> 10) << "kb");
 	}
@@ -222,7 +408,7 @@ namespace dsp56k
 
 		for (const auto parent : _block->getParents())
 		{
-			const auto& e = m_jitCache[parent];
+			const auto& e = m_cache->m_jitCache[parent];
 			if (isBeingGeneratedRecursive(e.block))
 				return true;
 		}
@@ -234,7 +420,7 @@ namespace dsp56k
 		if (_block == nullptr)
 			return false;
 
-		for (auto it : m_generatingBlocks)
+		for (auto it : m_cache->m_generatingBlocks)
 		{
 			if (it.second == _block)
 				return true;
@@ -244,7 +430,20 @@ namespace dsp56k
 
 	void Jit::run(const TWord _pc)
 	{
-		const JitBlock* block = m_jitCache[_pc].block;
+		const JitBlock* block;
+
+		{
+			// another DSP that shares our code cache might have destroyed the block in the meantime
+			const Lock lock(m_cache->m_mutex);
+			block = m_cache->m_jitCache[_pc].block;
+		}
+
+		if(!block)
+		{
+			create(_pc, true);
+			return;
+		}
+
 		block->getFunc()(this, _pc);
 
 		if(g_traceOps)
@@ -260,6 +459,85 @@ namespace dsp56k
 		}
 	}
 
+	void Jit::traceBlock(TraceRecorder& _recorder, const TWord _pc, const uint32_t _instructions) const
+	{
+		const JitBlock* block = m_cache->m_jitCache[_pc].block;
+
+		// the block might have been destroyed by a write to P memory
+		if(!block)
+			return;
+
+		const TWord lastOpOffset = block->getPMemSize() - block->getLastOpSize();
+		TWord op, opB;
+		m_dsp.mem.getOpcode(_pc + lastOpOffset, op, opB);
+		_recorder.recordBlock(m_dsp, _pc, _instructions, lastOpOffset, op, opB, block->getLastOpSize());
+	}
+
+	bool Jit::isCompiled(const TWord _pc) const
+	{
+		return m_cache->m_jitCache[_pc].block != nullptr;
+	}
+
+	bool Jit::isIdleLoop(const TWord _pc) const
+	{
+		const auto* block = m_cache->m_jitCache[_pc].block;
+		return block && block->getPCFirst() == _pc && (block->getFlags() & JitBlock::IdleLoop);
+	}
+
+	uint64_t Jit::precompile(const ProgramAnalysis& _analysis)
+	{
+		const auto blocks = m_compileStats.blocks;
+
+		// a block ends where another one has been compiled already. Going downwards, every block ends at the next block start
+		const auto& starts = _analysis.getBlockStarts();
+
+		for(auto it = starts.rbegin(); it != starts.rend(); ++it)
+		{
+			const auto pc = it->first;
+			const auto& loop = it->second;
+
+			if(isCompiled(pc))
+				continue;
+
+			// a block is terminated at the loop end that is active while compiling it, see JitBlock::emit
+			m_hasCompileLoop = true;
+			m_compileLoopBegin = loop.isValid() ? loop.begin : g_invalidAddress;
+			m_compileLoopEnd = loop.isValid() ? loop.end : 0xffffff;
+
+			create(pc, false);
+
+			// blocks might end early, for example after a rep or a write to LA or LC. Compile what follows as well
+			for(auto next = pc; isCompiled(next);)
+			{
+				const auto* block = m_cache->m_jitCache[next].block;
+				next = block->getPCFirst() + block->getPMemSize();
+
+				if(next >= m_dsp.memory().size() || isCompiled(next) || !_analysis.isReachable(next))
+					break;
+
+				create(next, false);
+			}
+		}
+
+		m_hasCompileLoop = false;
+
+		return m_compileStats.blocks - blocks;
+	}
+
+	TWord Jit::getCompileLoopBegin() const
+	{
+		if(m_hasCompileLoop)
+			return m_compileLoopBegin;
+		return static_cast<TWord>(hiword(m_dsp.regs().ss[m_dsp.ssIndex()]).var);
+	}
+
+	TWord Jit::getCompileLoopEnd() const
+	{
+		if(m_hasCompileLoop)
+			return m_compileLoopEnd;
+		return static_cast<TWord>(m_dsp.regs().la.var);
+	}
+
 	void Jit::runCheckPMemWrite(const TWord _pc)
 	{
 		m_runtimeData.m_pMemWriteAddress = g_pcInvalid;
@@ -271,9 +549,23 @@ namespace dsp56k
 	{
 //		LOG("Create @ " << HEX(_pc));// << std::endl << cacheEntry.block->getDisasm());
 
-		auto& cacheEntry = m_jitCache[_pc];
+		{
+			const Lock lock(m_cache->m_mutex);
 
-		if(m_jitCache[_pc+1].block != nullptr)
+			// another DSP that shares our code cache might have created it in the meantime
+			if(m_jitFuncs[_pc] == &funcCreate)
+				createLocked(_pc);
+		}
+
+		if(_execute)
+			exec(_pc, m_jitFuncs[_pc]);
+	}
+
+	void Jit::createLocked(const TWord _pc)
+	{
+		auto& cacheEntry = m_cache->m_jitCache[_pc];
+
+		if(m_cache->m_jitCache[_pc+1].block != nullptr)
 		{
 			// we will generate a 1-word op, try to find in single op cache
 			TWord opA;
@@ -289,21 +581,22 @@ namespace dsp56k
 				cacheEntry.block = it->second;
 				cacheEntry.singleOpCache.erase(it);
 				m_jitFuncs[_pc] = updateRunFunc(cacheEntry);
-				if(_execute)
-					exec(_pc, m_jitFuncs[_pc]);
 				return;
 			}
 		}
 		emit(_pc);
-		if(_execute)
-			exec(_pc, m_jitFuncs[_pc]);
 	}
 
 	void Jit::recreate(const TWord _pc)
 	{
 		// there is code, but the JIT block does not start at the PC position that we want to run. We need to throw the block away and regenerate
 //		LOG("Unable to jump into the middle of a block, destroying existing block & recreating from " << HEX(pc));
-		destroy(_pc);
+		{
+			const Lock lock(m_cache->m_mutex);
+
+			if(m_jitFuncs[_pc] == &funcRecreate)
+				destroy(_pc);
+		}
 		create(_pc, true);
 	}
 
@@ -312,10 +605,10 @@ namespace dsp56k
 		if (_parent)
 			occupyArea(_parent);
 
-		if (m_volatileP.find(_pc) != m_volatileP.end())
+		if (m_cache->m_volatileP.find(_pc) != m_cache->m_volatileP.end())
 			return nullptr;
 
-		const auto& e = m_jitCache[_pc];
+		const auto& e = m_cache->m_jitCache[_pc];
 
 		if (e.block && e.block->getPCFirst() == _pc)
 		{
@@ -350,7 +643,7 @@ namespace dsp56k
 
 	bool Jit::canBeDefaultExecuted(TWord _pc) const
 	{
-		const auto& e = m_jitCache[_pc];
+		const auto& e = m_cache->m_jitCache[_pc];
 		if (!e.block)
 			return false;
 		return m_jitFuncs[_pc] == e.block->getFunc();
@@ -363,10 +656,11 @@ namespace dsp56k
 
 		for (auto i = first; i < last; ++i)
 		{
-			assert(m_jitCache[i].block == nullptr || m_jitCache[i].block == _block);
-			m_jitCache[i].block = _block;
+			auto& e = m_cache->m_jitCache[i];
+			assert(e.block == nullptr || e.block == _block);
+			e.block = _block;
 			if (i == first)
-				m_jitFuncs[i] = updateRunFunc(m_jitCache[i]);
+				m_jitFuncs[i] = updateRunFunc(e);
 			else
 				m_jitFuncs[i] = &funcRecreate;
 		}
@@ -395,10 +689,15 @@ namespace dsp56k
 		if (pMemWriteAddr == g_pcInvalid)
 			return;
 
-		if (m_jitCache[pMemWriteAddr].block)
-			m_volatileP.insert(pMemWriteAddr);
+		{
+			const Lock lock(m_cache->m_mutex);
+
+			if (m_cache->m_jitCache[pMemWriteAddr].block)
+				m_cache->m_volatileP.insert(pMemWriteAddr);
+
+			destroy(pMemWriteAddr);
+		}
 
-		notifyProgramMemWrite(pMemWriteAddr);
 		m_dsp.notifyProgramMemWrite(pMemWriteAddr);
 	}
 }
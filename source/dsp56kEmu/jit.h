@@ -3,25 +3,43 @@
 #include "jitcacheentry.h"
 #include "types.h"
 
+#include <atomic>
+#include <memory>
 #include <vector>
-#include <set>
 
 #include "jitruntimedata.h"
 
 #include "logging.h"
 
-namespace asmjit
-{
-	inline namespace _abi_1_8
-	{
-		class JitRuntime;
-	}
-}
-
 namespace dsp56k
 {
 	class DSP;
 	class JitBlock;
+	class ProgramAnalysis;
+	class TraceRecorder;
+	struct JitCodeCache;
+
+	extern std::atomic<uint64_t> g_jitRetireEpoch;
+
+	// Accumulated statistics of all blocks that have been compiled by a Jit instance. Times of a block exclude child blocks that were compiled recursively
+	struct JitCompileStats
+	{
+		uint64_t blocks = 0;
+		uint64_t instructions = 0;		// DSP instructions
+		uint64_t nodes = 0;				// asmjit builder nodes before finalize
+		uint64_t codeBytes = 0;			// generated host code
+		uint64_t spillsToXmm = 0;		// DSP registers moved from GP to XMM registers by the register pool
+		uint64_t spillsToMemory = 0;	// DSP registers moved from XMM registers back to memory by the register pool
+
+		uint64_t emitNs = 0;			// JitBlock::emit: building nodes, including register pool decisions
+		uint64_t finalizeNs = 0;		// builder finalize: passes and serialization to machine code
+		uint64_t addNs = 0;				// JitRuntime::add: relocation and copy to executable memory
+
+		uint64_t totalNs() const { return emitNs + finalizeNs + addNs; }
+
+		double codeBytesPerInstruction() const	{ return instructions ? static_cast<double>(codeBytes) / static_cast<double>(instructions) : 0.0; }
+		double blocksPerSecond() const			{ return totalNs() ? static_cast<double>(blocks) * 1e9 / static_cast<double>(totalNs()) : 0.0; }
+	};
 
 	class Jit final
 	{
@@ -35,15 +53,32 @@ namespace dsp56k
 		{
 //			LOG("Exec @ " << HEX(pc));
 
+			if(m_offline)
+				goOnline();
+
 			// get JIT code
 			exec(_pc, m_jitFuncs[_pc]);
-		}
 
-		void notifyProgramMemWrite(const TWord _offset)
-		{
-			destroy(_offset);
+			// Back in the dispatcher, no JIT code is on the stack anymore. Retired blocks of shared caches are no longer used by us
+			m_quiescentEpoch.store(g_jitRetireEpoch.load(std::memory_order_acquire), std::memory_order_release);
+
+			if(!m_detachedCaches.empty())
+				releaseDetachedCaches();
 		}
 
+		// Call if this instance will not run JIT code for a while, for example while its DSP is paused, waits for input or is run by the interpreter.
+		// Blocks retired from a shared code cache no longer wait for us to return to the dispatcher, the next exec() brings us back. Not callable from JIT code
+		void goOffline();
+
+		void notifyProgramMemWrite(TWord _offset);
+		void notifyProgramMemWrite(TWord _offset, TWord _count);
+		void notifyProgramMemorySharingChanged();
+		void notifyPeripheralsChanged();
+
+		// Use the code cache of another instance. Both instances need to use the same shared P memory image
+		bool shareCodeCache(Jit& _other);
+		bool isCodeCacheShared() const;
+
 		void run(TWord _pc);
 		void runCheckPMemWrite(TWord _pc);
 		void create(TWord _pc, bool _execute);
@@ -54,21 +89,38 @@ namespace dsp56k
 
 		void occupyArea(JitBlock* _block);
 
+		// records the block at _pc that has just been executed
+		void traceBlock(TraceRecorder& _recorder, TWord _pc, uint32_t _instructions) const;
+
+		JitRuntimeData& getRuntimeData() { return m_runtimeData; }
+
+		const JitCompileStats& getCompileStats() const { return m_compileStats; }
+		void resetCompileStats() { m_compileStats = JitCompileStats(); }
+
+		// returns true if _pc is part of a compiled block
+		bool isCompiled(TWord _pc) const;
+
+		// returns true if the block at _pc does nothing but poll a peripheral bit and branch to itself
+		bool isIdleLoop(TWord _pc) const;
+
+		// compiles all blocks that have been discovered by a program analysis without executing them. Returns the number of compiled blocks
+		uint64_t precompile(const ProgramAnalysis& _analysis);
+
+		// DO loop that is active for the code being compiled. Taken from the DSP registers unless precompile supplies it from a program analysis
+		TWord getCompileLoopBegin() const;
+		TWord getCompileLoopEnd() const;
+
 	private:
+		void createLocked(TWord _pc);
 		void emit(TWord _pc);
 		void destroyParents(JitBlock* _block);
 		void destroy(JitBlock* _block);
-		void destroy(TWord _pc)
-		{
-			const auto block = m_jitCache[_pc].block;
-			if (block)
-				destroy(block);
-		}
+		void destroy(TWord _pc);
 		void release(const JitBlock* _block);
 		bool isBeingGeneratedRecursive(const JitBlock* _block) const;
 		bool isBeingGenerated(const JitBlock* _block) const;
 
-		void exec(TWord _pc, const TJitFunc& _f)
+		void exec(TWord _pc, const TJitFunc _f)
 		{
 			_f(this, _pc);
 		}
@@ -76,16 +128,34 @@ namespace dsp56k
 		static TJitFunc updateRunFunc(const JitCacheEntry& e);
 
 		void checkPMemWrite();
+		void goOnline();
+
+		void setCodeCache(std::shared_ptr<JitCodeCache> _cache);
+		void detachCodeCache();
+		void releaseDetachedCaches();
+		void removeUser(JitCodeCache& _cache) const;
+		void updateMemoryPointers();
 
 		JitRuntimeData m_runtimeData;
 
 		DSP& m_dsp;
 
-		asmjit::_abi_1_8::JitRuntime* m_rt = nullptr;
-		std::vector<JitCacheEntry> m_jitCache;
-		std::vector<TJitFunc> m_jitFuncs;
-		std::set<TWord> m_volatileP;
-		std::map<TWord, JitBlock*> m_generatingBlocks;
-		size_t m_codeSize = 0;
+		JitCompileStats m_compileStats;
+		uint64_t m_nestedEmitNs = 0;	// time spent in emit() so far, used to exclude recursively compiled child blocks from the time of their parent
+
+		// loop context while precompiling. The DSP registers are not touched as the DSP might be running
+		bool m_hasCompileLoop = false;
+		TWord m_compileLoopBegin = 0;
+		TWord m_compileLoopEnd = 0;
+
+		std::shared_ptr<JitCodeCache> m_cache;
+		std::atomic<TJitFunc>* m_jitFuncs = nullptr;
+
+		// caches that we used before, kept alive until we return to the dispatcher as their code might still be on the call stack
+		std::vector<std::shared_ptr<JitCodeCache>> m_detachedCaches;
+
+		// value of g_jitRetireEpoch when we were last in the dispatcher. Blocks that have been retired before cannot be running here anymore
+		std::atomic<uint64_t> m_quiescentEpoch;
+		bool m_offline = false;
 	};
 }
@@ -4,11 +4,38 @@
 #include "jitblock.h"
 #include "jitops.h"
 #include "memory.h"
+#include "peripherals.h"
 
 namespace dsp56k
 {
 	constexpr uint32_t g_maxInstructionsPerBlock = 0;	// set to 1 for debugging/tracing
 
+	namespace
+	{
+		bool isPeripheralPollLoop(DSP& _dsp, const Instruction _inst, const TWord _op)
+		{
+			TWord addr;
+
+			switch (_inst)
+			{
+			case Jclr_pp:	case Jset_pp:
+			case Brclr_pp:	case Brset_pp:
+				addr = 0xffffc0 + getFieldValue(_inst, Field_pppppp, _op);
+				break;
+			case Jclr_qq:	case Jset_qq:
+			case Brclr_qq:	case Brset_qq:
+				addr = 0xffff80 + getFieldValue(_inst, Field_qqqqqq, _op);
+				break;
+			default:
+				return false;
+			}
+
+			// skipping iterations is only valid if polling does not change anything, reading a receive register for example consumes data
+			const auto* periph = _dsp.getPeriph(getFieldValue(_inst, Field_S, _op) ? 1 : 0);
+			return periph->isSideEffectFreeRead(addr);
+		}
+	}
+
 	JitBlock::JitBlock(JitEmitter& _a, DSP& _dsp, JitRuntimeData& _runtimeData)
 	: m_runtimeData(_runtimeData)
 	, m_asm(_a)
@@ -40,6 +67,9 @@ namespace dsp56k
 		m_dspAsm.clear();
 		bool shouldEmit = true;
 
+		// the DSP context pointer is derived from the first function argument and needs to be loaded before anything else
+		dspRegPool().loadDspPtr();
+
 		auto loopBegin = m_asm.newNamedLabel("loopBegin");
 		m_asm.bind(loopBegin);
 
@@ -47,9 +77,6 @@ namespace dsp56k
 		asmjit::BaseNode* cursorEndInsertPc = nullptr;
 		asmjit::BaseNode* cursorInsertEncodedInstructionCount = nullptr;
 
-		// needed so that the dsp register is available
-		dspRegPool().makeDspPtr(&m_dsp.getInstructionCounter(), sizeof(TWord));
-
 		if(!isFastInterrupt)
 		{
 			// TODO: remove the whole block is the function statically jumps to m_child
@@ -65,7 +92,8 @@ namespace dsp56k
 		uint32_t blockFlags = 0;
 		bool appendLoopCode = false;
 
-		const auto loopBeginAddr = hiword(m_dsp.regs().ss[m_dsp.ssIndex()]).var;
+		const auto loopBeginAddr = _jit->getCompileLoopBegin();
+		const auto loopEndAddr = _jit->getCompileLoopEnd();
 		bool isLoopStart = m_pcFirst == loopBeginAddr;
 
 		while(shouldEmit)
@@ -117,7 +145,7 @@ namespace dsp56k
 			m_lastOpSize = ops.getOpSize();
 
 			// always terminate block if loop end has reached
-			if((m_pcFirst + m_pMemSize) == static_cast<TWord>(m_dsp.regs().la.var + 1))
+			if((m_pcFirst + m_pMemSize) == loopEndAddr + 1)
 			{
 				appendLoopCode = true;
 				break;
@@ -144,6 +172,9 @@ namespace dsp56k
 
 						const auto pcLast = m_pcFirst + m_pMemSize;
 
+						if (branchTarget == m_pcFirst && m_encodedInstructionCount == 1 && isPeripheralPollLoop(m_dsp, oi.getInstruction(), opA))
+							m_flags |= IdleLoop;
+
 						// do not branch into ourself
 						if (branchTarget < m_pcFirst || branchTarget >= pcLast)
 						{
@@ -309,7 +340,7 @@ namespace dsp56k
 #endif
 
 				m_asm.jnz(skip);
-				m_stack.call(asmjit::func_as_ptr(child->getFunc()));
+				callChild(child);
 
 				if (m_nonBranchChild != g_invalidAddress)
 					m_asm.jmp(end);
@@ -319,13 +350,13 @@ namespace dsp56k
 				if(m_nonBranchChild != g_invalidAddress)
 				{
 					const auto nonBranchChild = _jit->getChildBlock(nullptr, m_nonBranchChild);
-					m_stack.call(asmjit::func_as_ptr(nonBranchChild->getFunc()));
+					callChild(nonBranchChild);
 				}
 				m_asm.bind(end);
 			}
 			else
 			{
-				m_stack.call(asmjit::func_as_ptr(child->getFunc()));
+				callChild(child);
 			}
 		}
 		else if (!appendLoopCode && !m_possibleBranch && !isFastInterrupt && _jit && _cache[pcNext].block && !blockFlags && !m_flags && m_child == g_invalidAddress && _jit->canBeDefaultExecuted(pcNext))
@@ -335,7 +366,7 @@ namespace dsp56k
 			{
 				m_child = pcNext;
 				child->addParent(m_pcFirst);
-				m_stack.call(asmjit::func_as_ptr(child->getFunc()));
+				callChild(child);
 			}
 		}
 		else if(appendLoopCode && isLoopStart)
@@ -386,4 +417,11 @@ namespace dsp56k
 	{
 		m_parents.insert(_pc);
 	}
+
+	void JitBlock::callChild(const JitBlock* _child)
+	{
+		// child blocks derive the DSP register base pointer from their first argument, which is the Jit instance
+		m_mem.getDspPtr(g_funcArgGPs[0], &m_dsp.getJit());
+		m_stack.call(asmjit::func_as_ptr(_child->getFunc()));
+	}
 }
@@ -28,7 +28,8 @@ namespace dsp56k
 		{
 			WritePMem			= 0x0002,
 			LoopEnd				= 0x0004,
-			InstructionLimit	= 0x0008
+			InstructionLimit	= 0x0008,
+			IdleLoop			= 0x0010	// single instruction that polls a peripheral bit and branches to itself
 		};
 
 		JitBlock(JitEmitter& _a, DSP& _dsp, JitRuntimeData& _runtimeData);
@@ -59,6 +60,7 @@ namespace dsp56k
 		TWord& nextPC() { return m_runtimeData.m_nextPC; }
 		uint32_t& pMemWriteAddress() { return m_runtimeData.m_pMemWriteAddress; }
 		uint32_t& pMemWriteValue() { return m_runtimeData.m_pMemWriteValue; }
+		JitRuntimeData& runtimeData() { return m_runtimeData; }
 		void setNextPC(const JitRegGP& _pc);
 
 		const std::string& getDisasm() const { return m_dspAsm; }
@@ -77,6 +79,8 @@ namespace dsp56k
 	private:
 		void addParent(TWord _pc);
 
+		void callChild(const JitBlock* _child);
+
 		class JitBlockGenerating
 		{
 		public:
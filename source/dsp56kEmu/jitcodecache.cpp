@@ -0,0 +1,82 @@
+#include "jitcodecache.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "jitblock.h"
+
+#include "asmjit/core/jitruntime.h"
+
+namespace dsp56k
+{
+	void funcCreate(Jit* _jit, TWord _pc);
+
+	std::atomic<uint64_t> g_jitRetireEpoch{0};
+
+	JitCodeCache::JitCodeCache(const TWord _pMemSize) : m_jitCache(_pMemSize), m_jitFuncs(_pMemSize)
+	{
+		for (auto& f : m_jitFuncs)
+			f = &funcCreate;
+
+		m_rt = new asmjit::JitRuntime();
+	}
+
+	JitCodeCache::~JitCodeCache()
+	{
+		for(size_t i=0; i<m_jitCache.size(); ++i)
+		{
+			auto& e = m_jitCache[i];
+
+			if(e.block && e.block->getPCFirst() == i)
+				delete e.block;
+
+			for (const auto& it : e.singleOpCache)
+				delete it.second;
+		}
+
+		for (const auto& r : m_retiredBlocks)
+			delete r.block;
+
+		// releases the code of all blocks at once
+		delete m_rt;
+	}
+
+	void JitCodeCache::retire(const JitBlock* _block)
+	{
+		// the block is no longer reachable via the lookup tables, but another DSP might be running it right now
+		m_retiredBlocks.push_back({_block, ++g_jitRetireEpoch});
+		reclaimRetiredBlocks();
+	}
+
+	void JitCodeCache::reclaimRetiredBlocks()
+	{
+		if(m_retiredBlocks.empty())
+			return;
+
+		// a user that has been back in its dispatcher after a block has been retired can no longer be running it
+		auto minEpoch = std::numeric_limits<uint64_t>::max();
+
+		for(const auto* u : m_users)
+			minEpoch = std::min(minEpoch, u->load(std::memory_order_acquire));
+
+		size_t kept = 0;
+
+		for(const auto& r : m_retiredBlocks)
+		{
+			if(r.epoch > minEpoch)
+				m_retiredBlocks[kept++] = r;
+			else
+				release(r.block);
+		}
+
+		m_retiredBlocks.resize(kept);
+	}
+
+	void JitCodeCache::release(const JitBlock* _block)
+	{
+		assert(m_codeSize >= _block->codeSize());
+		m_codeSize -= _block->codeSize();
+		m_rt->release(_block->getFunc());
+		delete _block;
+	}
+}
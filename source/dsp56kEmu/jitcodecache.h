@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "jitcacheentry.h"
+
+namespace asmjit
+{
+	inline namespace _abi_1_8
+	{
+		class JitRuntime;
+	}
+}
+
+namespace dsp56k
+{
+	// incremented whenever a block of a shared cache is retired. Global, as a Jit instance can be the user of multiple caches at the same time
+	extern std::atomic<uint64_t> g_jitRetireEpoch;
+
+	// Generated code and the PC => code lookup tables. Can be shared between multiple DSP instances that use the same shared P memory image,
+	// the generated code addresses all per-instance state relative to the DSP that calls it
+	struct JitCodeCache
+	{
+		explicit JitCodeCache(TWord _pMemSize);
+		~JitCodeCache();
+
+		JitCodeCache(const JitCodeCache&) = delete;
+		JitCodeCache& operator = (const JitCodeCache&) = delete;
+
+		void retire(const JitBlock* _block);
+		void reclaimRetiredBlocks();
+		void release(const JitBlock* _block);
+
+		asmjit::_abi_1_8::JitRuntime* m_rt = nullptr;
+
+		std::vector<JitCacheEntry> m_jitCache;
+		std::vector<std::atomic<TJitFunc>> m_jitFuncs;
+		std::set<TWord> m_volatileP;
+		std::map<TWord, JitBlock*> m_generatingBlocks;
+		size_t m_codeSize = 0;
+
+		// As soon as a cache is shared, blocks might still be executed by other threads after they have been destroyed.
+		// They are retired with a new epoch and freed once every user has been back in its dispatcher since then
+		bool m_shared = false;
+
+		struct RetiredBlock
+		{
+			const JitBlock* block;
+			uint64_t epoch;
+		};
+
+		std::vector<RetiredBlock> m_retiredBlocks;
+
+		// quiescent epochs of all Jit instances that use this cache, see Jit::exec
+		std::vector<const std::atomic<uint64_t>*> m_users;
+
+		std::recursive_mutex m_mutex;
+	};
+}
@@ -36,6 +36,23 @@ namespace dsp56k
 
 	static_assert(std::size(g_dspRegNames) == JitDspRegPool::DspCount);
 
+	namespace
+	{
+		// Registers that are accessed rarely compared to the ALU, data, status and address registers. If GPs run out, these are moved to XMM registers first
+		bool isColdReg(const JitDspRegPool::DspReg _reg)
+		{
+			switch (_reg)
+			{
+			case JitDspRegPool::DspPC:
+			case JitDspRegPool::DspLC:
+			case JitDspRegPool::DspLA:
+				return true;
+			default:
+				return (_reg >= JitDspRegPool::DspN0 && _reg <= JitDspRegPool::DspM7) || (_reg >= JitDspRegPool::DspM0mod && _reg <= JitDspRegPool::DspM7mask);
+			}
+		}
+	}
+
 	JitDspRegPool::JitDspRegPool(JitBlock& _block) : m_block(_block), m_lockedGps(0), m_writtenDspRegs(0)
 	{
 		clear();
@@ -330,6 +347,7 @@ namespace dsp56k
 
 					const auto res = release(dspReg);
 					assert(res && "unable to release XMM reg");
+					++m_spillsToMemory;
 					return true;
 				}
 				return false;
@@ -344,30 +362,42 @@ namespace dsp56k
 			}
 		}
 
-		// move the oldest used GP register to an XMM register
-		for(auto it = m_gpList.used().begin(); it != m_gpList.used().end(); ++it)
+		// move the oldest used GP register to an XMM register. Rarely accessed registers go first so that ALU and data registers keep their GPs
+		auto moveToXMM = [&](const bool _coldOnly)
 		{
-			const DspReg dspReg = *it;
+			for(auto it = m_gpList.used().begin(); it != m_gpList.used().end(); ++it)
+			{
+				const DspReg dspReg = *it;
 
-			if(isLocked(dspReg))
-				continue;
+				if(isLocked(dspReg))
+					continue;
 
-			if(dspReg == _wantedReg)
-				continue;
+				if(dspReg == _wantedReg)
+					continue;
 
-			LOGRP("Moving DSP reg " <<g_dspRegNames[dspReg] << " to XMM");
+				if(_coldOnly && !isColdReg(dspReg))
+					continue;
 
-			JitRegGP hostReg;
-			m_gpList.release(hostReg, dspReg, m_repMode);
+				LOGRP("Moving DSP reg " <<g_dspRegNames[dspReg] << " to XMM");
 
-			JitReg128 xmReg;
-			m_xmList.acquire(xmReg, dspReg, m_repMode);
-			m_block.stack().setUsed(xmReg);
+				JitRegGP hostReg;
+				m_gpList.release(hostReg, dspReg, m_repMode);
 
-			m_block.asm_().movq(xmReg, hostReg);
+				JitReg128 xmReg;
+				m_xmList.acquire(xmReg, dspReg, m_repMode);
+				m_block.stack().setUsed(xmReg);
 
+				m_block.asm_().movq(xmReg, hostReg);
+
+				++m_spillsToXmm;
+				return true;
+			}
+			return false;
+		};
+
+		if(moveToXMM(true) || moveToXMM(false))
 			return;
-		}
+
 		assert(false && "all GPs are locked, unable to make space");
 	}
 
@@ -726,16 +756,13 @@ namespace dsp56k
 
 	JitMemPtr JitDspRegPool::makeDspPtr(const void* _ptr, const size_t _size) const
 	{
+		assert(isDspPtr(_ptr) && "pointer does not point to a DSP member");
+
 		const void* base = &m_block.dsp().regs();
 		const auto offset = static_cast<const uint8_t*>(_ptr) - static_cast<const uint8_t*>(base);
-		assert(offset < 0xffffffff);
-		
+
 		if(!m_dspPtr.hasBase() || !m_dspPtr.hasSize())
-		{
-			m_block.stack().setUsed(regDspPtr);
-			m_block.asm_().mov(regDspPtr, asmjit::Imm(reinterpret_cast<uint64_t>(base)));
-			m_dspPtr = Jitmem::makePtr(regDspPtr, 0, static_cast<uint32_t>(_size));
-		}
+			loadDspPtr();
 
 		m_dspPtr.setSize(static_cast<uint32_t>(_size));
 		m_dspPtr.setOffset(offset);
@@ -743,6 +770,31 @@ namespace dsp56k
 		return m_dspPtr;
 	}
 
+	void JitDspRegPool::loadDspPtr() const
+	{
+		assert(!m_dspPtr.hasBase() && "DSP pointer already loaded");
+
+		// As the Jit is a member of the DSP, the registers are at a fixed offset to the Jit instance
+		const void* base = &m_block.dsp().regs();
+		const auto jitToRegs = static_cast<const uint8_t*>(base) - reinterpret_cast<const uint8_t*>(&m_block.dsp().getJit());
+		assert(jitToRegs > 0 && jitToRegs < 0x1000);
+
+		m_block.stack().setUsed(regDspPtr);
+#ifdef HAVE_ARM64
+		m_block.asm_().add(regDspPtr, g_funcArgGPs[0], asmjit::Imm(jitToRegs));
+#else
+		m_block.asm_().lea(regDspPtr, asmjit::x86::ptr(g_funcArgGPs[0], static_cast<int32_t>(jitToRegs)));
+#endif
+		m_dspPtr = Jitmem::makePtr(regDspPtr, 0, sizeof(TWord));
+	}
+
+	bool JitDspRegPool::isDspPtr(const void* _ptr) const
+	{
+		const auto* dsp = reinterpret_cast<const uint8_t*>(&m_block.dsp());
+		const auto* p = static_cast<const uint8_t*>(_ptr);
+		return p >= dsp && p < dsp + sizeof(DSP);
+	}
+
 	void JitDspRegPool::mov(const JitMemPtr& _dst, const JitRegGP& _src) const
 	{
 		m_block.asm_().mov(_dst, _src);
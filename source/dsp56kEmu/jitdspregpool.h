@@ -58,6 +58,7 @@ namespace dsp56k
 		bool isInUse(const JitReg128& _xmm) const;
 		bool isInUse(const JitRegGP& _gp) const;
 		bool isInUse(DspReg _reg) const;
+		bool isInGP(DspReg _reg) const { return m_gpList.isUsed(_reg); }
 
 		DspReg aquireTemp();
 		void releaseTemp(DspReg _reg);
@@ -93,6 +94,10 @@ namespace dsp56k
 			return m_dirty;
 		}
 
+		// number of DSP registers that had to be moved from GP to XMM registers / from XMM registers back to memory to make space
+		uint32_t getSpillsToXmm() const { return m_spillsToXmm; }
+		uint32_t getSpillsToMemory() const { return m_spillsToMemory; }
+
 
 		template<typename T, unsigned int B>
 		void movDspReg(const RegType<T, B>& _reg, const JitRegGP& _src) const
@@ -161,6 +166,10 @@ namespace dsp56k
 
 		JitMemPtr makeDspPtr(const void* _ptr, size_t _size) const;
 
+		// Loads the DSP context pointer register. JIT code is called with the Jit instance as first argument, all DSP state is addressed relative to it
+		void loadDspPtr() const;
+		bool isDspPtr(const void* _ptr) const;
+
 	private:
 		void parallelOpEpilog(DspReg _aluReadReg, DspReg _aluWriteReg);
 		
@@ -318,5 +327,8 @@ namespace dsp56k
 		bool m_repMode = false;
 		mutable JitMemPtr m_dspPtr;
 		bool m_dirty = false;
+
+		uint32_t m_spillsToXmm = 0;
+		uint32_t m_spillsToMemory = 0;
 	};
 }
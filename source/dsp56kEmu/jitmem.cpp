@@ -83,15 +83,15 @@ namespace dsp56k
 		const SkipLabel skip(m_block.asm_());
 
 #ifdef HAVE_X86_64
-		if(asmjit::Support::isPowerOf2(m_block.dsp().memory().size()))
+		if(asmjit::Support::isPowerOf2(m_block.dsp().memory().stride()))
 		{
 			// just return garbage in case memory is read from an invalid address
-			m_block.asm_().and_(_offset, asmjit::Imm(asmjit::Imm(m_block.dsp().memory().size()-1)));
+			m_block.asm_().and_(_offset, asmjit::Imm(asmjit::Imm(m_block.dsp().memory().stride()-1)));
 		}
 		else
 #endif
 		{
-			m_block.asm_().cmp(r32(_offset), asmjit::Imm(m_block.dsp().memory().size()));
+			m_block.asm_().cmp(r32(_offset), asmjit::Imm(m_block.dsp().memory().stride()));
 			m_block.asm_().jge(skip.get());
 		}
 
@@ -102,6 +102,16 @@ namespace dsp56k
 
 	void Jitmem::readDspMemory(const JitRegGP& _dstX, const JitRegGP& _dstY, const JitRegGP& _offsetX, const JitRegGP& _offsetY) const
 	{
+		if(canPairXY())
+		{
+			const auto ptrX = regSmallTemp;
+			getMemAreaPtr(ptrX, MemArea_X);
+
+			readPaired(_dstX, ptrX, MemArea_X, _offsetX);
+			readPaired(_dstY, ptrX, MemArea_Y, _offsetY);
+			return;
+		}
+
 		const auto pMem = regSmallTemp;
 		getMemAreaPtr(pMem, MemArea_P, 0);
 
@@ -115,18 +125,26 @@ namespace dsp56k
 		const SkipLabel skip(m_block.asm_());
 
 #ifdef HAVE_X86_64
-		if (asmjit::Support::isPowerOf2(m_block.dsp().memory().size()))
+		if (asmjit::Support::isPowerOf2(m_block.dsp().memory().stride()))
 		{
 			// just return garbage in case memory is read from an invalid address
-			m_block.asm_().and_(_offset, asmjit::Imm(asmjit::Imm(m_block.dsp().memory().size() - 1)));
+			m_block.asm_().and_(_offset, asmjit::Imm(asmjit::Imm(m_block.dsp().memory().stride() - 1)));
 		}
 		else
 #endif
 		{
-			m_block.asm_().cmp(r32(_offset), asmjit::Imm(m_block.dsp().memory().size()));
+			m_block.asm_().cmp(r32(_offset), asmjit::Imm(m_block.dsp().memory().stride()));
 			m_block.asm_().jge(skip.get());
 		}
 
+		if(canPairXY())
+		{
+			getMemAreaPtr(regSmallTemp, MemArea_X);
+			m_block.asm_().move(r32(_dstX), makePairedPtr(regSmallTemp, MemArea_X, _offset));
+			m_block.asm_().move(r32(_dstY), makePairedPtr(regSmallTemp, MemArea_Y, _offset));
+			return;
+		}
+
 		getMemAreaPtr(regSmallTemp, MemArea_P, 0);
 
 		getMemAreaPtr(t.get(), MemArea_X, _offset, regSmallTemp);
@@ -138,16 +156,19 @@ namespace dsp56k
 
 	void Jitmem::readDspMemory(const JitRegGP& _dstX, const JitRegGP& _dstY, const TWord& _offset) const
 	{
-		if (_offset >= m_block.dsp().memory().size())
+		if (_offset >= m_block.dsp().memory().stride())
 			return;
 
 		getMemAreaPtr(regSmallTemp, MemArea_X, _offset);
 		m_block.asm_().move(r32(_dstX), makePtr(regSmallTemp, 0, sizeof(TWord)));
 
-		const auto& mem = m_block.dsp().memory();
-		const auto off = reinterpret_cast<uint64_t>(mem.y) - reinterpret_cast<uint64_t>(mem.x);
+		if(canPairXY())
+		{
+			m_block.asm_().move(r32(_dstY), makePairedPtr(regSmallTemp, MemArea_Y));
+			return;
+		}
 
-		m_block.asm_().add(r64(regSmallTemp), off);
+		getMemAreaPtr(regSmallTemp, MemArea_Y, _offset);
 		m_block.asm_().move(r32(_dstY), makePtr(regSmallTemp, 0, sizeof(TWord)));
 	}
 
@@ -156,9 +177,8 @@ namespace dsp56k
 		const auto& mem = m_block.dsp().memory();
 		mem.memTranslateAddress(_area, _offset);
 
-		assert(_offset < mem.size() && "memory address out of range");
-
-		if (_offset >= mem.size())
+		// same as the interpreter: everything below the stride is backed by memory, accesses beyond are dropped
+		if (_offset >= mem.stride())
 			return;
 
 		const RegGP t(m_block);
@@ -175,6 +195,103 @@ namespace dsp56k
 		_dsp->memory().dspWrite(a, o, _value);
 	}
 
+	void callDSPMemWriteRuntimeData(DSP* const _dsp, const EMemArea _area)
+	{
+		const auto& rt = _dsp->getJit().getRuntimeData();
+		callDSPMemWrite(_dsp, _area, rt.m_memWriteOffset, rt.m_memWriteValue);
+	}
+
+	bool Jitmem::canPairXY() const
+	{
+#ifdef HAVE_X86_64
+		// X and Y memory are consecutive in the memory buffer. If no external memory is bridged to P, Y can be addressed via
+		// the X memory pointer plus a constant displacement. ARM64 has no addressing mode with index register and displacement
+		const auto& mem = m_block.dsp().memory();
+		return mem.getMemAreaPtr(MemArea_Y) == mem.getMemAreaPtr(MemArea_X) + mem.stride() && mem.getBridgedMemoryAddress() >= mem.stride();
+#else
+		return false;
+#endif
+	}
+
+	JitMemPtr Jitmem::makePairedPtr(const JitReg64& _ptrX, const EMemArea _area, const JitRegGP& _offset) const
+	{
+#ifdef HAVE_X86_64
+		const auto displacement = _area == MemArea_Y ? static_cast<int32_t>(m_block.dsp().memory().stride() * sizeof(TWord)) : 0;
+		return asmjit::x86::ptr(_ptrX, _offset, 2, displacement, sizeof(TWord));
+#else
+		assert(false && "paired X:Y access is not supported");
+		return makePtr(_ptrX, _offset, 2, sizeof(TWord));
+#endif
+	}
+
+	JitMemPtr Jitmem::makePairedPtr(const JitReg64& _ptrX, const EMemArea _area) const
+	{
+		const auto displacement = _area == MemArea_Y ? m_block.dsp().memory().stride() * sizeof(TWord) : 0;
+		return makePtr(_ptrX, static_cast<uint32_t>(displacement), sizeof(TWord));
+	}
+
+	void Jitmem::readPaired(const JitRegGP& _dst, const JitReg64& _ptrX, const EMemArea _area, const JitRegGP& _offset) const
+	{
+		const SkipLabel skip(m_block.asm_());
+
+		if(asmjit::Support::isPowerOf2(m_block.dsp().memory().stride()))
+		{
+			// just return garbage in case memory is read from an invalid address
+			m_block.asm_().and_(_offset, asmjit::Imm(m_block.dsp().memory().stride() - 1));
+		}
+		else
+		{
+			m_block.asm_().cmp(r32(_offset), asmjit::Imm(m_block.dsp().memory().stride()));
+			m_block.asm_().jge(skip.get());
+		}
+
+		m_block.asm_().move(r32(_dst), makePairedPtr(_ptrX, _area, _offset));
+	}
+
+	void Jitmem::writePaired(const JitReg64& _ptrX, const EMemArea _area, const JitRegGP& _offset, const JitRegGP& _src) const
+	{
+		const SkipLabel skip(m_block.asm_());
+
+		m_block.asm_().cmp(r32(_offset), asmjit::Imm(m_block.dsp().memory().stride()));
+		m_block.asm_().jge(skip.get());
+
+		m_block.asm_().mov(makePairedPtr(_ptrX, _area, _offset), r32(_src));
+	}
+
+	bool Jitmem::needsMemWriteCall(const EMemArea _area) const
+	{
+		const auto& mem = m_block.dsp().memory();
+
+		if(!mem.isProgramMemoryShared())
+			return false;
+
+		// a shared P memory image is never written to directly. Writes to P or to external memory that is bridged to P need to go
+		// through Memory::dspWrite, which creates a private copy of P memory first
+		return _area == MemArea_P || mem.getBridgedMemoryAddress() < mem.stride();
+	}
+
+	void Jitmem::callMemWrite(const EMemArea _area, const JitRegGP& _offset, const JitRegGP& _src) const
+	{
+		// arguments are passed via runtime data as offset and source might be located in function argument registers
+		auto& rt = m_block.runtimeData();
+		m_block.dspRegPool().movDspReg(rt.m_memWriteOffset, _offset);
+		m_block.dspRegPool().movDspReg(rt.m_memWriteValue, _src);
+
+		FuncArg r0(m_block, 0);
+		FuncArg r1(m_block, 1);
+
+		getDspPtr(r0, &m_block.dsp());
+		m_block.asm_().mov(r32(r1.get()), asmjit::Imm(_area));
+
+		m_block.stack().call(asmjit::func_as_ptr(&callDSPMemWriteRuntimeData));
+	}
+
+	void Jitmem::callMemWrite(const EMemArea _area, const TWord _offset, const JitRegGP& _src) const
+	{
+		m_block.asm_().mov(r32(regSmallTemp), asmjit::Imm(_offset));
+		callMemWrite(_area, regSmallTemp, _src);
+	}
+
 	void Jitmem::writeDspMemory(const EMemArea _area, const JitRegGP& _offset, const JitRegGP& _src, const JitReg64& _basePtrPmem/* = JitReg64()*/) const
 	{
 #ifdef DEBUG_MEMORY_WRITES
@@ -182,18 +299,24 @@ namespace dsp56k
 		FuncArg r2(m_block, 2);
 		FuncArg r3(m_block, 3);
 
-		m_block.asm_().mov(g_funcArgGPs[0], asmjit::Imm(&m_block.dsp()));
+		getDspPtr(g_funcArgGPs[0], &m_block.dsp());
 		m_block.asm_().mov(r1, _area);
 		m_block.asm_().mov(r2, _offset);
 		m_block.asm_().mov(r3, _src);
 
 		m_block.stack().call(asmjit::func_as_ptr(&callDSPMemWrite));
 #else
+		if(needsMemWriteCall(_area))
+		{
+			callMemWrite(_area, _offset, _src);
+			return;
+		}
+
 		const RegGP t(m_block);
 
 		const SkipLabel skip(m_block.asm_());
 
-		m_block.asm_().cmp(r32(_offset), asmjit::Imm(m_block.dsp().memory().size()));
+		m_block.asm_().cmp(r32(_offset), asmjit::Imm(m_block.dsp().memory().stride()));
 		m_block.asm_().jge(skip.get());
 
 		getMemAreaPtr(t.get(), _area, _offset, _basePtrPmem);
@@ -204,6 +327,23 @@ namespace dsp56k
 
 	void Jitmem::writeDspMemory(const JitRegGP& _offsetX, const JitRegGP& _offsetY, const JitRegGP& _srcX, const JitRegGP& _srcY) const
 	{
+		if(needsMemWriteCall(MemArea_X))
+		{
+			writeDspMemory(MemArea_X, _offsetX, _srcX);
+			writeDspMemory(MemArea_Y, _offsetY, _srcY);
+			return;
+		}
+
+		if(canPairXY())
+		{
+			const auto ptrX = regSmallTemp;
+			getMemAreaPtr(ptrX, MemArea_X);
+
+			writePaired(ptrX, MemArea_X, _offsetX, _srcX);
+			writePaired(ptrX, MemArea_Y, _offsetY, _srcY);
+			return;
+		}
+
 		const auto pMem = regSmallTemp;
 		getMemAreaPtr(pMem, MemArea_P, 0);
 
@@ -213,12 +353,27 @@ namespace dsp56k
 
 	void Jitmem::writeDspMemory(const JitRegGP& _offset, const JitRegGP& _srcX, const JitRegGP& _srcY) const
 	{
+		if(needsMemWriteCall(MemArea_X))
+		{
+			callMemWrite(MemArea_X, _offset, _srcX);
+			callMemWrite(MemArea_Y, _offset, _srcY);
+			return;
+		}
+
 		const RegGP t(m_block);
 		const SkipLabel skip(m_block.asm_());
 
-		m_block.asm_().cmp(r32(_offset), asmjit::Imm(m_block.dsp().memory().size()));
+		m_block.asm_().cmp(r32(_offset), asmjit::Imm(m_block.dsp().memory().stride()));
 		m_block.asm_().jge(skip.get());
 
+		if(canPairXY())
+		{
+			getMemAreaPtr(regSmallTemp, MemArea_X);
+			m_block.asm_().mov(makePairedPtr(regSmallTemp, MemArea_X, _offset), r32(_srcX));
+			m_block.asm_().mov(makePairedPtr(regSmallTemp, MemArea_Y, _offset), r32(_srcY));
+			return;
+		}
+
 		getMemAreaPtr(regSmallTemp, MemArea_P, 0);
 
 		getMemAreaPtr(t.get(), MemArea_X, _offset, regSmallTemp);
@@ -230,16 +385,26 @@ namespace dsp56k
 
 	void Jitmem::writeDspMemory(const TWord& _offset, const JitRegGP& _srcX, const JitRegGP& _srcY) const
 	{
-		if (_offset >= m_block.dsp().memory().size())
+		if (_offset >= m_block.dsp().memory().stride())
+			return;
+
+		if(needsMemWriteCall(MemArea_X))
+		{
+			callMemWrite(MemArea_X, _offset, _srcX);
+			callMemWrite(MemArea_Y, _offset, _srcY);
 			return;
+		}
 
 		getMemAreaPtr(regSmallTemp, MemArea_X, _offset);
 		m_block.asm_().mov(makePtr(regSmallTemp, 0, sizeof(TWord)), r32(_srcX));
 
-		const auto& mem = m_block.dsp().memory();
-		const auto off = reinterpret_cast<uint64_t>(mem.y) - reinterpret_cast<uint64_t>(mem.x);
+		if(canPairXY())
+		{
+			m_block.asm_().mov(makePairedPtr(regSmallTemp, MemArea_Y), r32(_srcY));
+			return;
+		}
 
-		m_block.asm_().add(r64(regSmallTemp), off);
+		getMemAreaPtr(regSmallTemp, MemArea_Y, _offset);
 		m_block.asm_().mov(makePtr(regSmallTemp, 0, sizeof(TWord)), r32(_srcY));
 	}
 
@@ -253,10 +418,14 @@ namespace dsp56k
 		auto& mem = m_block.dsp().memory();
 		mem.memTranslateAddress(_area, _offset);
 
-		assert(_offset < mem.size() && "memory address out of range");
+		if(_offset >= mem.stride())
+			return;
 
-		if(_offset >= mem.size())
+		if(_area == MemArea_P && needsMemWriteCall(_area))
+		{
+			callMemWrite(_area, _offset, _src);
 			return;
+		}
 
 		const RegGP t(m_block);
 
@@ -276,14 +445,35 @@ namespace dsp56k
 		_dsp->getPeriph(_area)->write(_offset, _value);
 	}
 
+	bool Jitmem::canAccessPeriphDirectly(const EMemArea _area, const TWord _offset, const uint8_t _access) const
+	{
+		auto* periph = m_block.dsp().getPeriph(_area == MemArea_Y ? 1 : 0);
+		return (periph->getRegisterAccess(_offset) & _access) && periph->getRegisterStorage();
+	}
+
+	void Jitmem::getPeriphStoragePtr(const JitReg64& _dst, const EMemArea _area) const
+	{
+		// the storage pointer is read from the runtime data as it is different per DSP instance
+		const auto& ptr = m_block.runtimeData().m_periphStoragePtrs[_area == MemArea_Y ? 1 : 0];
+		m_block.asm_().move(_dst, m_block.dspRegPool().makeDspPtr(&ptr, sizeof(ptr)));
+	}
+
 	void Jitmem::readPeriph(const JitReg64& _dst, EMemArea _area, const TWord& _offset, Instruction _inst) const
 	{
+		// registers without side effects are loaded directly
+		if(canAccessPeriphDirectly(_area, _offset, PeriphAccessRead))
+		{
+			getPeriphStoragePtr(_dst, _area);
+			m_block.asm_().move(r32(_dst), makePtr(_dst, static_cast<uint32_t>((_offset - XIO_Reserved_High_First) * sizeof(TWord)), sizeof(TWord)));
+			return;
+		}
+
 		FuncArg r0(m_block, 0);
 		FuncArg r1(m_block, 1);
 		FuncArg r2(m_block, 2);
 		FuncArg r3(m_block, 3);
 
-		m_block.asm_().mov(r0, asmjit::Imm(&m_block.dsp()));
+		getDspPtr(r0, &m_block.dsp());
 		m_block.asm_().mov(r1, _area == MemArea_Y ? 1 : 0);
 		m_block.asm_().mov(r2, asmjit::Imm(_offset));
 		m_block.asm_().mov(r3, asmjit::Imm(_inst));
@@ -300,7 +490,7 @@ namespace dsp56k
 		FuncArg r2(m_block, 2);
 		FuncArg r3(m_block, 3);
 
-		m_block.asm_().mov(r0, asmjit::Imm(&m_block.dsp()));
+		getDspPtr(r0, &m_block.dsp());
 		m_block.asm_().mov(r1, _area == MemArea_Y ? 1 : 0);
 		m_block.asm_().mov(r2, _offset);
 		m_block.asm_().mov(r3, asmjit::Imm(_inst));
@@ -317,7 +507,7 @@ namespace dsp56k
 		FuncArg r2(m_block, 2);
 		FuncArg r3(m_block, 3);
 
-		m_block.asm_().mov(r0, asmjit::Imm(&m_block.dsp()));
+		getDspPtr(r0, &m_block.dsp());
 		m_block.asm_().mov(r1, _area == MemArea_Y ? 1 : 0);
 		m_block.asm_().mov(r2, _offset);
 		m_block.asm_().mov(r3, _value);
@@ -327,12 +517,21 @@ namespace dsp56k
 
 	void Jitmem::writePeriph(EMemArea _area, const TWord& _offset, const JitReg64& _value) const
 	{
+		// registers without side effects are stored directly
+		if(canAccessPeriphDirectly(_area, _offset, PeriphAccessWrite))
+		{
+			const RegGP t(m_block);
+			getPeriphStoragePtr(t, _area);
+			m_block.asm_().mov(makePtr(t, static_cast<uint32_t>((_offset - XIO_Reserved_High_First) * sizeof(TWord)), sizeof(uint32_t)), r32(_value));
+			return;
+		}
+
 		FuncArg r0(m_block, 0);
 		FuncArg r1(m_block, 1);
 		FuncArg r2(m_block, 2);
 		FuncArg r3(m_block, 3);
 
-		m_block.asm_().mov(r0, asmjit::Imm(&m_block.dsp()));
+		getDspPtr(r0, &m_block.dsp());
 		m_block.asm_().mov(r1, _area == MemArea_Y ? 1 : 0);
 		m_block.asm_().mov(r2, asmjit::Imm(_offset));
 		m_block.asm_().mov(r3, _value);
@@ -345,35 +544,27 @@ namespace dsp56k
 		getMemAreaPtr(_dst, MemArea_P);
 	}
 
-	void Jitmem::getMemAreaPtr(const JitReg64& _dst, EMemArea _area, TWord offset/* = 0*/, const JitRegGP& _ptrToPmem/* = JitRegGP()*/) const
+	void Jitmem::getMemAreaPtr(const JitReg64& _dst, EMemArea _area, TWord _offset/* = 0*/) const
 	{
-		auto& mem = m_block.dsp().memory();
+		assert(_area < MemArea_COUNT && "invalid memory area");
 
-		TWord* ptr = nullptr;
+		// memory pointers are read from the runtime data, they are different per DSP instance and might change at runtime
+		const auto& ptr = m_block.runtimeData().m_memAreaPtrs[_area];
+		m_block.asm_().move(_dst, m_block.dspRegPool().makeDspPtr(&ptr, sizeof(ptr)));
 
-		switch (_area)
-		{
-		case MemArea_X:		ptr = mem.x; break;
-		case MemArea_Y:		ptr = mem.y; break;
-		case MemArea_P:		ptr = mem.p; break;
-		default:
-			assert(0 && "invalid memory area");
-			break;
-		}
+		if(_offset)
+			m_block.asm_().add(_dst, asmjit::Imm(static_cast<uint64_t>(_offset) * sizeof(TWord)));
+	}
 
-		if(_ptrToPmem.isValid())
-		{
-			const auto off = reinterpret_cast<int64_t>(ptr) - reinterpret_cast<int64_t>(mem.p) + static_cast<int64_t>(offset) * sizeof(TWord);
+	void Jitmem::getDspPtr(const JitReg64& _dst, const void* _ptr) const
+	{
+		const auto p = m_block.dspRegPool().makeDspPtr(_ptr, sizeof(uint64_t));
 #ifdef HAVE_ARM64
-			m_block.asm_().add(_dst, _ptrToPmem, off);
+		m_block.asm_().mov(_dst, asmjit::Imm(p.offset()));
+		m_block.asm_().add(_dst, regDspPtr, _dst);
 #else
-			m_block.asm_().lea(_dst, asmjit::x86::ptr(_ptrToPmem, static_cast<int>(off)));
+		m_block.asm_().lea(_dst, p);
 #endif
-		}
-		else
-		{
-			return ptrToReg(_dst, ptr + offset);
-		}
 	}
 
 	void Jitmem::getMemAreaPtr(const JitReg64& _dst, EMemArea _area, const JitRegGP& _offset, const JitReg64& _ptrToPmem/* = JitRegGP()*/) const
@@ -392,7 +583,7 @@ namespace dsp56k
 			p = regSmallTemp;
 			getMemAreaPtr(p, MemArea_P);
 		}
-		getMemAreaPtr(_dst, _area, 0, p);
+		getMemAreaPtr(_dst, _area);
 
 		m_block.asm_().cmp(r32(_offset), asmjit::Imm(m_block.dsp().memory().getBridgedMemoryAddress()));
 #ifdef HAVE_ARM64
@@ -405,6 +596,10 @@ namespace dsp56k
 	template<typename T>
 	JitMemPtr Jitmem::ptr(const JitReg64& _temp, const T* _t) const
 	{
+		// DSP state is addressed relative to the context register, code that accesses it does not depend on the DSP instance
+		if(m_block.dspRegPool().isDspPtr(_t))
+			return m_block.dspRegPool().makeDspPtr(_t, sizeof(T));
+
 		ptrToReg<T>(_temp, _t);
 		return makePtr(_temp, 0, sizeof(T));
 	}
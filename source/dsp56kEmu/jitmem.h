@@ -59,9 +59,27 @@ namespace dsp56k
 
 		void getPMemBasePtr(const JitReg64& _dst) const;
 
+		// _dst = address of _ptr, which needs to point to a member of the DSP. Calculated relative to the DSP register base pointer
+		void getDspPtr(const JitReg64& _dst, const void* _ptr) const;
+
 	private:
-		void getMemAreaPtr(const JitReg64& _dst, EMemArea _area, TWord offset = 0, const JitRegGP& _ptrToPmem = JitRegGP()) const;
+		void getMemAreaPtr(const JitReg64& _dst, EMemArea _area, TWord _offset = 0) const;
 		void getMemAreaPtr(const JitReg64& _dst, EMemArea _area, const JitRegGP& _offset, const JitReg64& _ptrToPmem = JitReg64()) const;
+
+		// true if the peripheral register at _offset can be accessed without calling the peripheral, _access is a PeripheralRegisterAccess
+		bool canAccessPeriphDirectly(EMemArea _area, TWord _offset, uint8_t _access) const;
+		void getPeriphStoragePtr(const JitReg64& _dst, EMemArea _area) const;
+
+		// true if X and Y memory can both be addressed relative to the X memory pointer, which saves pointer loads for parallel X:Y moves
+		bool canPairXY() const;
+		JitMemPtr makePairedPtr(const JitReg64& _ptrX, EMemArea _area, const JitRegGP& _offset) const;
+		JitMemPtr makePairedPtr(const JitReg64& _ptrX, EMemArea _area) const;
+		void readPaired(const JitRegGP& _dst, const JitReg64& _ptrX, EMemArea _area, const JitRegGP& _offset) const;
+		void writePaired(const JitReg64& _ptrX, EMemArea _area, const JitRegGP& _offset, const JitRegGP& _src) const;
+
+		bool needsMemWriteCall(EMemArea _area) const;
+		void callMemWrite(EMemArea _area, const JitRegGP& _offset, const JitRegGP& _src) const;
+		void callMemWrite(EMemArea _area, TWord _offset, const JitRegGP& _src) const;
 		JitBlock& m_block;
 	};
 }
@@ -798,6 +798,10 @@ namespace dsp56k
 			m_opSize++;
 			return;
 		}
+		else if(_lc > 1 && rep_shift(opA, _lc))
+		{
+			return;
+		}
 
 		// regular processing
 		RegGP lc(m_block);
@@ -805,6 +809,85 @@ namespace dsp56k
 		rep_exec(lc, _lc);
 	}
 
+	bool JitOps::rep_shift(const TWord _op, const TWord _lc)
+	{
+		// rep #n / asl, asr, lsl or lsr without parallel move: the first n-1 iterations are merged into a single shift that does
+		// not touch the CCR, the last one is emitted as usual as it is the only one that determines the resulting CCR bits
+		if(!(_op & 0xff))
+			return false;
+
+		const auto* oiMove = m_opcodes.findParallelMoveOpcodeInfo(_op);
+		if(!oiMove || oiMove->getInstruction() != Move_Nop)
+			return false;
+
+		const auto* oiAlu = m_opcodes.findParallelAluOpcodeInfo(_op);
+		if(!oiAlu)
+			return false;
+
+		const auto inst = oiAlu->getInstruction();
+		const auto shift = _lc - 1;
+
+		switch (inst)
+		{
+		case Asl_D:
+			{
+				AluRef d(m_block, getFieldValue<Asl_D, Field_d>(_op));
+				if(shift >= 56)
+				{
+					m_asm.clr(d.get());
+				}
+				else
+				{
+					m_asm.shl(d.get(), asmjit::Imm(shift));
+					m_dspRegs.mask56(d.get());
+				}
+			}
+			break;
+		case Asr_D:
+			{
+				AluRef d(m_block, getFieldValue<Asr_D, Field_d>(_op));
+				m_asm.sal(d.get(), asmjit::Imm(8));
+				m_asm.sar(d.get(), asmjit::Imm(std::min(shift + 8, 63u)));
+				m_dspRegs.mask56(d.get());
+			}
+			break;
+		case Lsl_D:
+		case Lsr_D:
+			{
+				const auto ab = inst == Lsl_D ? getFieldValue<Lsl_D, Field_D>(_op) : getFieldValue<Lsr_D, Field_D>(_op);
+
+				const RegGP d(m_block);
+				getALU1(d, ab);
+				if(shift >= 24)
+				{
+					m_asm.clr(d.get());
+				}
+				else if(inst == Lsl_D)
+				{
+					m_asm.shl(r32(d.get()), asmjit::Imm(shift));
+					m_asm.and_(r32(d.get()), asmjit::Imm(0xffffff));
+				}
+				else
+				{
+					m_asm.shr(r32(d.get()), asmjit::Imm(shift));
+				}
+				setALU1(ab, r32(d.get()));
+			}
+			break;
+		default:
+			return false;
+		}
+
+		m_block.getEncodedInstructionCount() += _lc;
+
+		// last iteration
+		const auto opSize = m_opSize;
+		emit(m_pcCurrentOp + opSize);
+		m_opSize += opSize;
+
+		return true;
+	}
+
 	void JitOps::rep_exec(RegGP& _lc, TWord _lcImmediateOperand)
 	{
 		const auto hasImmediateOperand = _lcImmediateOperand != std::numeric_limits<TWord>::max();
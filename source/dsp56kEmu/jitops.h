@@ -548,6 +548,7 @@ namespace dsp56k
 		void do_end(const RegGP& _temp);
 		void do_end();
 		void rep_exec(TWord _lc);
+		bool rep_shift(TWord _op, TWord _lc);
 		void rep_exec(RegGP& _lc, TWord _lcImmediateOperand);
 
 		// -------------- bra variants
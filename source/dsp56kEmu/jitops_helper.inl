@@ -258,10 +258,13 @@ namespace dsp56k
 		const RegGP r(m_block);
 		m_asm.mov(r32(r.get()), asmjit::Imm(_mode));
 
-		if constexpr (sizeof(m_block.dsp().m_processingMode) == sizeof(uint32_t))
-			m_block.mem().mov(reinterpret_cast<uint32_t&>(m_block.dsp().m_processingMode), r);
-		else if constexpr (sizeof(m_block.dsp().m_processingMode) == sizeof(uint64_t))
-			m_block.mem().mov(reinterpret_cast<uint64_t&>(m_block.dsp().m_processingMode), r);
+		const auto& mode = m_block.dsp().m_processingMode;
+		const auto ptr = m_block.dspRegPool().makeDspPtr(&mode, sizeof(mode));
+
+		if constexpr (sizeof(mode) == sizeof(uint32_t))
+			m_asm.mov(ptr, r32(r.get()));
+		else if constexpr (sizeof(mode) == sizeof(uint64_t))
+			m_asm.mov(ptr, r64(r.get()));
 	}
 
 	inline TWord JitOps::getOpWordB()
@@ -395,7 +398,7 @@ namespace dsp56k
 	void JitOps::callDSPFunc(void(* _func)(DSP*, TWord)) const
 	{
 		FuncArg r0(m_block, 0);
-		m_block.asm_().mov(r0, asmjit::Imm(&m_block.dsp()));
+		m_block.mem().getDspPtr(r0, &m_block.dsp());
 		m_block.stack().call(asmjit::func_as_ptr(_func));
 	}
 
@@ -566,8 +566,8 @@ namespace dsp56k
 			if (eaType == Dynamic)	m_block.mem().writeDspMemory(MemArea_P, ea, r);
 			else					m_block.mem().writeDspMemory(MemArea_P, m_opWordB, r);
 
-			m_block.mem().mov(m_block.pMemWriteAddress(), r32(ea.get()));
-			m_block.mem().mov(m_block.pMemWriteValue(), r32(r.get()));
+			m_block.dspRegPool().movDspReg(m_block.pMemWriteAddress(), ea.get());
+			m_block.dspRegPool().movDspReg(m_block.pMemWriteValue(), r.get());
 
 			m_asm.bind(skip);
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include "types.h"
 
 namespace dsp56k
@@ -11,5 +13,15 @@ namespace dsp56k
 		TWord m_nextPC = g_pcInvalid;
 		TWord m_pMemWriteAddress = g_pcInvalid;
 		TWord m_pMemWriteValue = 0;
+
+		// memory is not addressed via absolute pointers to make JIT code usable by multiple DSP instances
+		std::array<TWord*, MemArea_COUNT> m_memAreaPtrs{};
+
+		// register storage of the X and Y peripherals for registers that can be accessed without calling the peripheral
+		std::array<TWord*, 2> m_periphStoragePtrs{};
+
+		// arguments for memory writes that need to be done in C++ code, see Jitmem::writeDspMemory
+		TWord m_memWriteOffset = 0;
+		TWord m_memWriteValue = 0;
 	};
 }
@@ -29,6 +29,8 @@ namespace dsp56k
 
 		runTest(&JitUnittests::transferSaturation_build, &JitUnittests::transferSaturation_verify);
 
+		regPoolEviction();
+
 		{
 			constexpr auto T=true;
 			constexpr auto F=false;
@@ -80,6 +82,7 @@ namespace dsp56k
 		dec();
 		div();
 		rep_div();
+		rep_shift();
 		dmac();
 		extractu();
 		ifcc();
@@ -154,10 +157,10 @@ namespace dsp56k
 
 		LOG("Creating test code");
 
-		JitRuntimeData rtData;
-
 		{
-			JitBlock block(m_asm, dsp, rtData);
+			JitBlock block(m_asm, dsp, dsp.getJit().getRuntimeData());
+
+			block.dspRegPool().loadDspPtr();
 
 			JitOps ops(block);
 
@@ -170,8 +173,7 @@ namespace dsp56k
 
 		m_asm.finalize();
 
-		typedef void (*Func)();
-		Func func;
+		TJitFunc func;
 		const auto err = m_rt.add(&func, &code);
 		if(err)
 		{
@@ -187,7 +189,7 @@ namespace dsp56k
 		{
 			LOG("Running test code");
 
-			func();
+			func(&dsp.getJit(), 0);
 
 			LOG("Verifying test code");
 
@@ -1512,6 +1514,78 @@ namespace dsp56k
 		});
 	}
 
+	void JitUnittests::regPoolEviction()
+	{
+		runTest([&](JitBlock& _block, JitOps& _ops)
+		{
+			auto& pool = _block.dspRegPool();
+
+			// A is the least recently used register but N registers are moved to XMM first if GPs run out
+			pool.get(JitDspRegPool::DspA, true, false);
+
+			for(auto r = JitDspRegPool::DspN0; r <= JitDspRegPool::DspN7; r = static_cast<JitDspRegPool::DspReg>(r + 1))
+				pool.get(r, true, false);
+
+			assert(pool.isInGP(JitDspRegPool::DspA));
+			assert(pool.isInUse(JitDspRegPool::DspN0));
+			assert(!pool.isInGP(JitDspRegPool::DspN0));
+		},
+		[&]()
+		{
+		});
+	}
+
+	void JitUnittests::rep_shift()
+	{
+		runTest([&](auto& _block, auto& _ops)
+		{
+			dsp.regs().a.var = 0x00012345678901;
+			dsp.setSR(0x0800d4);
+
+			dsp.memory().set(MemArea_P, 0, 0x0608a0);	// rep #<8
+			dsp.memory().set(MemArea_P, 1, 0x200032);	// asl a
+
+			_ops.emit(0);
+		},
+		[&]()
+		{
+			assert(dsp.regs().a.var == 0x01234567890100);
+			assert(!dsp.sr_test_noCache(CCR_C));
+			assert(!dsp.sr_test_noCache(CCR_V));
+		});
+
+		runTest([&](auto& _block, auto& _ops)
+		{
+			dsp.regs().a.var = 0xff800000000008;
+			dsp.setSR(0x0800d4);
+
+			dsp.memory().set(MemArea_P, 0, 0x0604a0);	// rep #<4
+			dsp.memory().set(MemArea_P, 1, 0x200022);	// asr a
+
+			_ops.emit(0);
+		},
+		[&]()
+		{
+			assert(dsp.regs().a.var == 0xfff80000000000);
+			assert(dsp.sr_test_noCache(CCR_C));
+		});
+
+		runTest([&](auto& _block, auto& _ops)
+		{
+			dsp.regs().a.var = 0xffaabbcc112233;
+
+			dsp.memory().set(MemArea_P, 0, 0x0604a0);	// rep #<4
+			dsp.memory().set(MemArea_P, 1, 0x200023);	// lsr a
+
+			_ops.emit(0);
+		},
+		[&]()
+		{
+			assert(dsp.regs().a.var == 0xff0aabbc112233);
+			assert(dsp.sr_test_noCache(CCR_C));
+		});
+	}
+
 	void JitUnittests::dmac()
 	{
 		runTest([&](JitBlock& _block, JitOps& _ops)
@@ -2529,6 +2603,31 @@ namespace dsp56k
 		{
 			assert(dsp.y1() == 0x8899aa);
 		});
+
+		// plain storage registers are accessed by the JIT without calling the peripherals, registers with side effects are not
+		assert(peripherals.getRegisterAccess(0xffffff) == PeriphAccessReadWrite);
+		assert(peripherals.getRegisterAccess(HI08::HSR) == PeriphAccessCall);
+
+		runTest([&](JitBlock& _block, JitOps& _ops)
+		{
+			peripherals.write(0xffffff, 0);
+			_ops.emit(0, 0x08f4bf, 0x123456);	// movep #>$123456,x:<<$ffffff
+		},
+		[&]()
+		{
+			assert(peripherals.read(0xffffff, Movep_ppea) == 0x123456);
+		});
+
+		runTest([&](JitBlock& _block, JitOps& _ops)
+		{
+			peripherals.write(0xffffff, 0x654321);
+			dsp.y1(0);
+			_ops.emit(0, 0x08473f);	// movep x:<<$ffffff,y1
+		},
+		[&]()
+		{
+			assert(dsp.y1() == 0x654321);
+		});
 	}
 
 	void JitUnittests::parallel()
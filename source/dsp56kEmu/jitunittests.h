@@ -132,6 +132,8 @@ namespace dsp56k
 		void dec();
 		void div();
 		void rep_div();
+		void rep_shift();
+		void regPoolEviction();
 		void dmac();
 		void extractu();
 		void ifcc();
@@ -1,11 +1,17 @@
 #include "logging.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
 #include <cstring>
 
+#include "ringbuffer.h"
+
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
@@ -93,5 +99,153 @@ namespace Logging
 			}));
 		}
 	}
-}
 
+	// ___ binary logging
+
+	namespace
+	{
+		struct ThreadLog
+		{
+			dsp56k::RingBuffer<LogRecord, 1024, false> records;
+			std::atomic<uint32_t> dropped{0};
+			std::atomic<bool> orphaned{false};
+		};
+
+		class BinaryLogWriter
+		{
+		public:
+			BinaryLogWriter()
+			{
+				m_thread.reset(new std::thread([this]
+				{
+					threadFunc();
+				}));
+			}
+
+			~BinaryLogWriter()
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_exit = true;
+				}
+				m_cv.notify_one();
+				m_thread->join();
+
+				flush();
+			}
+
+			void add(std::shared_ptr<ThreadLog> _log)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_logs.push_back(std::move(_log));
+			}
+
+			void flush()
+			{
+				std::lock_guard<std::mutex> lockFlush(m_flushMutex);
+
+				std::vector<std::shared_ptr<ThreadLog>> logs;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					logs = m_logs;
+				}
+
+				for (const auto& log : logs)
+					drain(*log);
+
+				// logs of threads that exited can go once they are empty
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_logs.erase(std::remove_if(m_logs.begin(), m_logs.end(), [](const std::shared_ptr<ThreadLog>& _log)
+				{
+					return _log->orphaned && _log->records.empty();
+				}), m_logs.end());
+			}
+
+		private:
+			void threadFunc()
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+
+				while(!m_exit)
+				{
+					m_cv.wait_for(lock, std::chrono::milliseconds(10), [this] { return m_exit; });
+
+					lock.unlock();
+					flush();
+					lock.lock();
+				}
+			}
+
+			static void drain(ThreadLog& _log)
+			{
+				char temp[1024];
+
+				while(!_log.records.empty())
+				{
+					const auto& r = _log.records.front();
+
+					const int offset = snprintf(temp, sizeof(temp), "%s@%d: ", r.site->func, r.site->line);
+					r.format(temp + offset, sizeof(temp) - offset, r.site->format, r.args);
+
+					_log.records.pop_front();
+
+					g_logToConsole(temp);
+				}
+
+				if(const auto dropped = _log.dropped.exchange(0))
+				{
+					snprintf(temp, sizeof(temp), "%u log records dropped", dropped);
+					g_logToConsole(temp);
+				}
+			}
+
+			std::mutex m_mutex;
+			std::mutex m_flushMutex;
+			std::condition_variable m_cv;
+			bool m_exit = false;
+			std::vector<std::shared_ptr<ThreadLog>> m_logs;
+			std::unique_ptr<std::thread> m_thread;
+		};
+
+		BinaryLogWriter& getBinaryLogWriter()
+		{
+			static BinaryLogWriter writer;
+			return writer;
+		}
+
+		struct ThreadLogOwner
+		{
+			ThreadLogOwner() : log(std::make_shared<ThreadLog>())
+			{
+				getBinaryLogWriter().add(log);
+			}
+
+			~ThreadLogOwner()
+			{
+				log->orphaned = true;
+			}
+
+			std::shared_ptr<ThreadLog> log;
+		};
+	}
+
+	void pushRecord(const LogRecord& _record)
+	{
+		thread_local ThreadLogOwner owner;
+
+		auto& log = *owner.log;
+
+		if(log.records.full())
+		{
+			++log.dropped;
+			return;
+		}
+
+		log.records.push_back(_record);
+	}
+
+	void flushBinaryLogs()
+	{
+		getBinaryLogWriter().flush();
+	}
+}
@@ -1,8 +1,28 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <iomanip>
+#include <type_traits>
+#include <utility>
+
+// Compile-time level filter for the binary log macros. Records above this level are compiled out
+#define LOG_LEVEL_ERROR		0
+#define LOG_LEVEL_WARNING	1
+#define LOG_LEVEL_INFO		2
+#define LOG_LEVEL_DEBUG		3
+
+#ifndef LOG_LEVEL
+#	ifdef _DEBUG
+#		define LOG_LEVEL		LOG_LEVEL_DEBUG
+#	else
+#		define LOG_LEVEL		LOG_LEVEL_INFO
+#	endif
+#endif
 
 namespace Logging
 {
@@ -20,6 +40,106 @@ namespace Logging
 		snprintf( buf.get(), size, format.c_str(), args ... );
 		return std::string( buf.get(), buf.get() + size - 1 ); // We don't want the '\0' inside
 	}
+
+	// ___ binary logging
+	//
+	// A binary log record only stores a pointer to its static call site and the raw arguments. It is pushed into a lock-free ring
+	// of the calling thread and formatted by a background thread. Logging never blocks, records are dropped if the ring is full.
+	// Arguments need to be trivially copyable, strings need to be string literals or have static storage duration
+
+	enum class Level : uint8_t
+	{
+		Error = LOG_LEVEL_ERROR,
+		Warning = LOG_LEVEL_WARNING,
+		Info = LOG_LEVEL_INFO,
+		Debug = LOG_LEVEL_DEBUG
+	};
+
+	struct LogSite
+	{
+		Level level;
+		const char* func;
+		int line;
+		const char* format;
+	};
+
+	struct LogRecord
+	{
+		static constexpr size_t MaxArgSize = 48;
+
+		using FormatFunc = int(*)(char* _dst, size_t _size, const char* _format, const uint8_t* _args);
+
+		const LogSite* site;
+		FormatFunc format;
+		alignas(8) uint8_t args[MaxArgSize];
+	};
+
+	void pushRecord(const LogRecord& _record);
+
+	// formats all pending records of all threads synchronously
+	void flushBinaryLogs();
+
+	template<typename T> using LogArg = std::conditional_t<std::is_same_v<std::decay_t<T>, float>, double, std::decay_t<const T>>;
+
+	template<typename... Args> constexpr std::array<size_t, sizeof...(Args) + 1> logArgOffsets()
+	{
+		std::array<size_t, sizeof...(Args) + 1> res{};
+		const size_t sizes[] = {sizeof(Args)..., 0};
+
+		for(size_t i=0; i<sizeof...(Args); ++i)
+			res[i+1] = res[i] + sizes[i];
+
+		return res;
+	}
+
+	template<typename T> T readLogArg(const uint8_t* _src)
+	{
+		T res;
+		memcpy(&res, _src, sizeof(T));
+		return res;
+	}
+
+	template<typename T> void writeLogArg(uint8_t* _dst, const T& _value)
+	{
+		memcpy(_dst, &_value, sizeof(T));
+	}
+
+	template<typename... Args, size_t... I> int formatLogRecord(char* _dst, const size_t _size, const char* _format, const uint8_t* _args, std::index_sequence<I...>)
+	{
+		if constexpr (sizeof...(Args) == 0)
+		{
+			return snprintf(_dst, _size, "%s", _format);
+		}
+		else
+		{
+			constexpr auto offsets = logArgOffsets<Args...>();
+			return snprintf(_dst, _size, _format, readLogArg<Args>(_args + offsets[I])...);
+		}
+	}
+
+	template<typename... Args> int formatLogRecord(char* _dst, const size_t _size, const char* _format, const uint8_t* _args)
+	{
+		return formatLogRecord<Args...>(_dst, _size, _format, _args, std::index_sequence_for<Args...>());
+	}
+
+	template<typename... Args> void logBinary(const LogSite& _site, const Args&... _args)
+	{
+		static_assert((std::is_trivially_copyable_v<LogArg<Args>> && ...), "log arguments need to be trivially copyable");
+		static_assert(logArgOffsets<LogArg<Args>...>().back() <= LogRecord::MaxArgSize, "too many log arguments");
+
+		LogRecord r;
+		r.site = &_site;
+		r.format = &formatLogRecord<LogArg<Args>...>;
+
+		if constexpr (sizeof...(Args) > 0)
+		{
+			constexpr auto offsets = logArgOffsets<LogArg<Args>...>();
+			size_t i = 0;
+			(writeLogArg<LogArg<Args>>(r.args + offsets[i++], _args), ...);
+		}
+
+		pushRecord(r);
+	}
 }
 
 #define LOGTOCONSOLE(ss)	{ Logging::g_logToConsole( (ss).str() ); }
@@ -40,5 +160,19 @@ namespace Logging
 
 #define LOGFMT(fmt, ...)	LOG(Logging::string_format(fmt,  ##__VA_ARGS__))
 
+#define LOGB(LEVEL, FORMAT, ...)																						\
+{																															\
+	if constexpr(static_cast<int>(LEVEL) <= LOG_LEVEL)																		\
+	{																														\
+		static const Logging::LogSite site{LEVEL, __FUNCTION__, __LINE__, FORMAT};											\
+		Logging::logBinary(site, ##__VA_ARGS__);																			\
+	}																														\
+}
+
+#define LOGB_ERROR(FORMAT, ...)		LOGB(Logging::Level::Error, FORMAT, ##__VA_ARGS__)
+#define LOGB_WARNING(FORMAT, ...)	LOGB(Logging::Level::Warning, FORMAT, ##__VA_ARGS__)
+#define LOGB_INFO(FORMAT, ...)		LOGB(Logging::Level::Info, FORMAT, ##__VA_ARGS__)
+#define LOGB_DEBUG(FORMAT, ...)		LOGB(Logging::Level::Debug, FORMAT, ##__VA_ARGS__)
+
 #define HEX(S)			std::hex << std::setfill('0') << std::setw(6) << S
 #define HEXN(S, n)		std::hex << std::setfill('0') << std::setw(n) << (uint32_t)S
@@ -1,38 +1,115 @@
 #include "memory.h"
 
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 
 
 #include "disasm.h"
+#include "dsp.h"
 #include "error.h"
 #include "omfloader.h"
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 namespace dsp56k
 {
 	constexpr bool g_useInitPattern	= false;
 	constexpr TWord g_initPattern	= 0xabcabcab;
 
+	// Reserve address space instead of allocating a zero-filled vector. The OS hands out zero pages and only commits
+	// physical memory for pages that are actually written, so a 0xc00000 words * 3 memory costs next to nothing until used
+	constexpr bool g_useSparseMemory = true;
+
+	namespace
+	{
+		size_t pageSize()
+		{
+#ifdef _WIN32
+			SYSTEM_INFO si;
+			GetSystemInfo(&si);
+			return si.dwPageSize;
+#else
+			return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+		}
+
+		void* reserveZeroPages(const size_t _bytes)
+		{
+#ifdef _WIN32
+			// committed pages are still backed by the zero page until first write
+			return VirtualAlloc(nullptr, _bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+			auto* p = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			return p == MAP_FAILED ? nullptr : p;
+#endif
+		}
+
+		void releasePages(void* _ptr, const size_t _bytes)
+		{
+#ifdef _WIN32
+			VirtualFree(_ptr, 0, MEM_RELEASE);
+#else
+			munmap(_ptr, _bytes);
+#endif
+		}
+	}
+
 	// _____________________________________________________________________________
 	// Memory
 	//
 	Memory::Memory(const IMemoryValidator& _memoryMap, TWord _memSize/* = 0xc00000*/, TWord* _externalBuffer/* = nullptr*/)
+		: Memory(_memoryMap, _memSize, _memSize, _memSize, _externalBuffer)
+	{
+	}
+
+	Memory::Memory(const IMemoryValidator& _memoryMap, const TWord _sizeP, const TWord _sizeX, const TWord _sizeY, TWord* _externalBuffer/* = nullptr*/)
 		: m_memoryMap(_memoryMap)
-		, m_size(_memSize)
-		, m_bridgedMemoryAddress(_memSize)
+		, m_stride(std::max(_sizeP, std::max(_sizeX, _sizeY)))
+		, m_bridgedMemoryAddress(m_stride)
 		, m_dsp(nullptr)
 	{
+		m_sizes[MemArea_P] = _sizeP;
+		m_sizes[MemArea_X] = _sizeX;
+		m_sizes[MemArea_Y] = _sizeY;
+
 		auto* address = _externalBuffer;
 
+		if(!address && g_useSparseMemory)
+		{
+			const auto ps = pageSize();
+			const auto bytes = (static_cast<size_t>(m_stride) * MemArea_COUNT * sizeof(TWord) + ps - 1) & ~(ps - 1);
+
+			address = static_cast<TWord*>(reserveZeroPages(bytes));
+
+			if(address)
+			{
+				m_reservedBuffer = address;
+				m_reservedBytes = bytes;
+			}
+			else
+			{
+				LOG("Failed to reserve " << bytes << " bytes of address space for DSP memory, falling back to regular allocation");
+			}
+		}
+
 		if(!address)
 		{
-			m_buffer.resize(_memSize * MemArea_COUNT, 0);
+			m_buffer.resize(static_cast<size_t>(m_stride) * MemArea_COUNT, 0);
 			address = &m_buffer[0];
 		}
 
-		p = address;	address += size();
-		x = address;	address += size();
+		p = address;	address += m_stride;
+		m_ownP = p;
+		x = address;	address += m_stride;
 		y = address;
 
 		m_mem[MemArea_X] = x;
@@ -41,13 +118,19 @@ namespace dsp56k
 
 #if MEMORY_HEAT_MAP
 		for(size_t i=0; i<MemArea_COUNT; ++i)
-			m_heatMap[i].resize(size());
+			m_heatMap[i].resize(m_stride);
 #endif
 
 		if(g_useInitPattern)
 			fillWithInitPattern();
 	}
 
+	Memory::~Memory()
+	{
+		if(m_reservedBuffer)
+			releasePages(m_reservedBuffer, m_reservedBytes);
+	}
+
 	// _____________________________________________________________________________
 	// set
 	//
@@ -59,12 +142,20 @@ namespace dsp56k
 
 		memTranslateAddress(_area, _offset);
 
+		if(_area == MemArea_P && m_sharedP && _offset < m_stride)
+		{
+			// the shared image is never written to, writing a different value creates a private copy first
+			if(p[_offset] == (_value & 0x00ffffff))
+				return true;
+			detachSharedProgramMemory();
+		}
+
 #ifdef _DEBUG
 		assert(_offset < XIO_Reserved_High_First);
 		if(!m_memoryMap.memValidateAccess(_area, _offset, true))
 			return false;
 
-		if( _offset >= size() )
+		if( _offset >= size(_area) )
 		{
 			LOG_ERR_MEM_WRITE( _offset );
 			return false;
@@ -89,8 +180,9 @@ namespace dsp56k
 			}
 		}
 */
-		if (_offset<0xff0000)	// Fix the amazing "write to wrong address" bug.
-		m_mem[_area][_offset] = _value & 0x00ffffff;
+		// Fix the amazing "write to wrong address" bug. Addresses beyond the stride are not backed by memory, the JIT drops them, too
+		if (_offset < m_stride)
+			m_mem[_area][_offset] = _value & 0x00ffffff;
 
 		return true;
 	}
@@ -111,13 +203,14 @@ namespace dsp56k
 		if(!m_memoryMap.memValidateAccess(_area, _offset, true))
 			return false;
 
-		if( _offset >= size() )
+		if( _offset >= size(_area) )
 		{
 			LOG_ERR_MEM_READ( _offset );
 			return 0x00badbad;
 		}
 #endif
 
+		// reads are only bounds checked in debug builds to keep the interpreter fast
 		const auto res = m_mem[_area][_offset];
 
 #ifdef _DEBUG
@@ -160,13 +253,117 @@ namespace dsp56k
 #endif
 	}
 
+	// _____________________________________________________________________________
+	// shared P memory
+	//
+	SharedProgramMemory Memory::shareProgramMemory()
+	{
+		if(m_sharedP)
+			return m_sharedP;
+
+		auto image = std::make_shared<const std::vector<TWord>>(p, p + m_stride);
+		useSharedProgramMemory(image);
+		return image;
+	}
+
+	bool Memory::useSharedProgramMemory(const SharedProgramMemory& _image)
+	{
+		if(!_image || _image->size() != m_stride)
+		{
+			LOG("Shared P memory image size " << (_image ? _image->size() : 0) << " does not match memory layout, expected " << m_stride << " words");
+			return false;
+		}
+
+		m_sharedP = _image;
+
+		// JIT code and the interpreter never write to P directly while it is shared, all writes go through dspWrite(), which detaches first
+		setProgramMemoryPtr(const_cast<TWord*>(m_sharedP->data()));
+		return true;
+	}
+
+	void Memory::detachSharedProgramMemory()
+	{
+		// copy on write: the first write to P makes this instance use its own P memory. Only pages that differ are copied, which keeps
+		// pages that are empty in both untouched and therefore uncommitted in sparse mode
+		const size_t pageWords = std::max<size_t>(1, pageSize() / sizeof(TWord));
+
+		for(size_t i=0; i<m_stride; i += pageWords)
+		{
+			const auto count = std::min<size_t>(pageWords, m_stride - i);
+
+			if(memcmp(m_ownP + i, p + i, count * sizeof(TWord)) != 0)
+				memcpy(m_ownP + i, p + i, count * sizeof(TWord));
+		}
+
+		m_sharedP.reset();
+		setProgramMemoryPtr(m_ownP);
+	}
+
+	void Memory::getCommittedPages(std::vector<bool>& _pages, const EMemArea _area, const TWord _pageWords) const
+	{
+		const auto count = (size(_area) + _pageWords - 1) / _pageWords;
+
+		_pages.assign(count, true);
+
+#ifndef _WIN32
+		const auto* mem = m_mem[_area];
+
+		// a shared P image is a regular allocation
+		if(!m_reservedBuffer || mem < m_reservedBuffer || mem >= m_reservedBuffer + m_reservedBytes / sizeof(TWord))
+			return;
+
+#ifdef __APPLE__
+		using ResidencyFlag = char;
+#else
+		using ResidencyFlag = unsigned char;
+#endif
+		const auto ps = pageSize();
+		const auto begin = reinterpret_cast<uintptr_t>(mem) & ~(ps - 1);
+		const auto end = reinterpret_cast<uintptr_t>(mem + size(_area));
+
+		// a page that has been read but never written maps the zero page and is reported as resident, too
+		std::vector<ResidencyFlag> resident((end - begin + ps - 1) / ps);
+
+		if(mincore(reinterpret_cast<void*>(begin), end - begin, resident.data()) != 0)
+			return;
+
+		for(size_t i=0; i<count; ++i)
+		{
+			const auto first = (reinterpret_cast<uintptr_t>(mem + i * _pageWords) - begin) / ps;
+			const auto last = (reinterpret_cast<uintptr_t>(mem + std::min<size_t>(size(_area), (i + 1) * _pageWords)) - 1 - begin) / ps;
+
+			bool committed = false;
+
+			for(auto p = first; p <= last && !committed; ++p)
+				committed = (resident[p] & 1) != 0;
+
+			_pages[i] = committed;
+		}
+#endif
+	}
+
+	void Memory::setProgramMemoryPtr(TWord* _p)
+	{
+		p = _p;
+		m_mem[MemArea_P] = _p;
+
+		if(m_dsp)
+			m_dsp->getJit().notifyProgramMemorySharingChanged();
+	}
+
 	// _____________________________________________________________________________
 	// loadOMF
 	//
 	bool Memory::loadOMF( const std::string& _filename )
 	{
 		OMFLoader loader;
-		return loader.load( _filename, *this );
+		if(!loader.load( _filename, *this ))
+			return false;
+
+		if(m_dsp)
+			m_dsp->notifyProgramLoaded();
+
+		return true;
 	}
 
 	// _____________________________________________________________________________
@@ -177,7 +374,7 @@ namespace dsp56k
 		for(size_t a=0; a<m_mem.size(); ++a)
 		{
 			const auto& data = m_mem[a];
-			fwrite( &data[0], sizeof( data[0] ), size(), _file );
+			fwrite( &data[0], sizeof( data[0] ), size(static_cast<EMemArea>(a)), _file );
 		}
 		return true;
 	}
@@ -187,14 +384,71 @@ namespace dsp56k
 	//
 	bool Memory::load( FILE* _file )
 	{
+		if(m_sharedP)
+			detachSharedProgramMemory();
+
 		for(size_t a=0; a<m_mem.size(); ++a)
 		{
 			const auto& data = m_mem[a];
-			fread( &data[0], sizeof( data[0] ), size(), _file );
+			fread( &data[0], sizeof( data[0] ), size(static_cast<EMemArea>(a)), _file );
 		}
 		return true;
 	}
 
+	// _____________________________________________________________________________
+	// restore
+	//
+	TWord Memory::restore(const EMemArea _area, const TWord _offset, const TWord* _src, const TWord _count)
+	{
+		assert(_offset + _count <= size(_area) && "memory range out of bounds");
+
+		const TWord* cur = m_mem[_area] + _offset;
+
+		// quick check first, most pages are usually unchanged
+		bool equal = true;
+		if(_src)
+		{
+			equal = memcmp(cur, _src, _count * sizeof(TWord)) == 0;
+		}
+		else
+		{
+			for(TWord i=0; i<_count && equal; ++i)
+				equal = cur[i] == 0;
+		}
+
+		if(equal)
+			return 0;
+
+		if(_area == MemArea_P && m_sharedP)
+			detachSharedProgramMemory();
+
+		TWord* dst = m_mem[_area] + _offset;
+
+		TWord changed = 0;
+		TWord first = _count;
+		TWord last = 0;
+
+		for(TWord i=0; i<_count; ++i)
+		{
+			const TWord v = _src ? _src[i] : 0;
+
+			if(dst[i] == v)
+				continue;
+
+			dst[i] = v;
+			++changed;
+
+			first = std::min(first, i);
+			last = i;
+		}
+
+		// invalidate the changed range once instead of taking the JIT lock for every word
+		if(_area == MemArea_P && m_dsp && changed)
+			m_dsp->clearOpcodeCache(_offset + first, last - first + 1);
+
+		return changed;
+	}
+
 	bool Memory::save(const char* _file, EMemArea _area) const
 	{
 		FILE* hFile = fopen(_file, "wb");
@@ -202,7 +456,9 @@ namespace dsp56k
 			return false;
 
 		std::vector<uint8_t> buf;
-		buf.resize(size() * 3);
+		const auto count = size(_area);
+
+		buf.resize(count * 3);
 
 		std::ofstream out(_file, std::ios::binary | std::ios::trunc);
 
@@ -211,7 +467,7 @@ namespace dsp56k
 
 		size_t index = 0;
 
-		for(uint32_t i=0; i<size(); ++i)
+		for(uint32_t i=0; i<count; ++i)
 		{
 			const auto w = get(_area, i);
 
@@ -220,7 +476,7 @@ namespace dsp56k
 			buf[index++] =(w) & 0xff;;
 		}
 
-		out.write(reinterpret_cast<const char*>(&buf.front()), size() * 3);
+		out.write(reinterpret_cast<const char*>(&buf.front()), count * 3);
 
 		out.close();
 
@@ -356,16 +612,16 @@ namespace dsp56k
 		if(!out.is_open())
 			return false;
 
+		const size_t a = MemArea_P;
+
+		const auto& hm = m_heatMap[a];
+
 		const uint32_t width = 512;
-		const uint32_t height = size() / 512;
+		const uint32_t height = static_cast<uint32_t>(hm.size() / width);
 
 		out << "P3" << std::endl;
 		out << width << ' ' << height << std::endl;
 		out << "255" << std::endl;
-
-		const size_t a = MemArea_P;
-
-		const auto& hm = m_heatMap[a];
 		size_t maxVal = 0;
 		for(size_t i=0; i<hm.size(); ++i)
 			maxVal = std::max(maxVal, (size_t)hm[i]);
@@ -397,7 +653,7 @@ namespace dsp56k
 		for (size_t a=0; a<MemArea_COUNT; ++a)
 		{
 			m_heatMap[a].clear();
-			m_heatMap[a].resize(size());
+			m_heatMap[a].resize(m_stride);
 		}
 #endif
 	}
@@ -460,7 +716,7 @@ namespace dsp56k
 	{
 		for(size_t a=0; a<m_mem.size(); ++a)
 		{
-			for(size_t i=0; i<size(); ++i)
+			for(size_t i=0; i<size(static_cast<EMemArea>(a)); ++i)
 				m_mem[a][i] = g_initPattern;
 		}
 	}
@@ -2,6 +2,7 @@
 
 #include <array>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -45,6 +46,9 @@ namespace dsp56k
 		bool memValidateAccess(EMemArea _area, TWord _addr, bool _write) const override	{ return true; }
 	};
 
+	// immutable P memory image that can be used by multiple Memory instances running the same firmware
+	using SharedProgramMemory = std::shared_ptr<const std::vector<TWord>>;
+
 	class Memory final
 	{
 		friend class Jitmem;
@@ -55,15 +59,27 @@ namespace dsp56k
 
 		const IMemoryValidator&								m_memoryMap;
 		
-		// number of words of 24-bit data for 3 banks (XYP)
-		const TWord											m_size;
+		// number of words of 24-bit data per bank (PXY)
+		StaticArray< TWord, MemArea_COUNT >					m_sizes;
+
+		// distance in words between the banks, the largest bank size. Every bank can be addressed up to this
+		// range without leaving the allocation, which is what the JIT relies on for its address masking
+		TWord												m_stride;
 		std::vector<TWord>									m_buffer;
+
+		// sparse mode: address space is reserved up front, pages are committed by the OS on first touch
+		TWord*												m_reservedBuffer = nullptr;
+		size_t												m_reservedBytes = 0;
 		StaticArray< TWord*, MemArea_COUNT >				m_mem;
 
 		TWord*												x;
 		TWord*												y;
 		TWord*												p;
 
+		// P memory owned by this instance, p points to the shared image instead as long as it is in use
+		TWord*												m_ownP;
+		SharedProgramMemory									m_sharedP;
+
 		TWord												m_bridgedMemoryAddress;
 
 #if MEMORY_HEAT_MAP
@@ -96,6 +112,10 @@ namespace dsp56k
 		//
 	public:
 		Memory(const IMemoryValidator& _memoryMap, TWord _memSize = 0xc00000, TWord* _externalBuffer = nullptr);
+		// _externalBuffer, if specified, needs to be large enough to hold stride() * MemArea_COUNT words. All areas are laid out with a
+		// distance of stride() words, smaller areas only save memory in sparse mode, where the unused tail of an area is never committed
+		Memory(const IMemoryValidator& _memoryMap, TWord _sizeP, TWord _sizeX, TWord _sizeY, TWord* _externalBuffer = nullptr);
+		~Memory();
 		Memory(const Memory&) = delete;
 		Memory& operator = (const Memory&) = delete;
 
@@ -110,6 +130,9 @@ namespace dsp56k
 		bool				save				( FILE* _file ) const;
 		bool				load				( FILE* _file );
 
+		// Writes _count words at _offset, _src == nullptr writes zeroes. Only words that differ are written, returns the number of changed words
+		TWord				restore				( EMemArea _area, TWord _offset, const TWord* _src, TWord _count );
+
 		bool				save				(const char* _file, EMemArea _area) const;
 		bool				saveAssembly		(const char* _file, TWord _offset, const TWord _count, bool _skipNops = true, bool _skipDC = false, IPeripherals* _peripherals = nullptr);
 
@@ -125,7 +148,15 @@ namespace dsp56k
 		const std::string&	getSymbol			(EMemArea _memArea, TWord addr) const;
 		const std::map<char, std::map<TWord, SSymbol>>& getSymbols() const { return m_symbols; }
 
-		TWord				size				() const	{ return m_size; }
+		// size of P memory, this is what per-PC tables such as the opcode cache and the JIT function table are sized by
+		TWord				size				() const	{ return m_sizes[MemArea_P]; }
+		TWord				size				(const EMemArea _area) const	{ return m_sizes[_area]; }
+		TWord				stride				() const	{ return m_stride; }
+		bool				isSparse			() const	{ return m_reservedBuffer != nullptr; }
+
+		// One entry per block of _pageWords words of _area, false if the block has never been touched and is therefore zero. All entries are
+		// true if this cannot be determined, i.e. if memory is not sparse or on platforms that cannot query it
+		void				getCommittedPages	(std::vector<bool>& _pages, EMemArea _area, TWord _pageWords) const;
 
 		void				setExternalMemory	(const TWord _address, bool _isExternalMemoryBridged)
 		{
@@ -134,8 +165,17 @@ namespace dsp56k
 
 		const TWord&		getBridgedMemoryAddress() const { return m_bridgedMemoryAddress; }
 
+		// Creates an immutable copy of the current P memory and switches to it. Pass it to other instances via useSharedProgramMemory()
+		SharedProgramMemory	shareProgramMemory	();
+		bool				useSharedProgramMemory(const SharedProgramMemory& _image);
+		const SharedProgramMemory& getSharedProgramMemory() const	{ return m_sharedP; }
+		bool				isProgramMemoryShared() const			{ return m_sharedP != nullptr; }
+		TWord*				getMemAreaPtr		(const EMemArea _area) const	{ return m_mem[_area]; }
+
 	private:
 		void				fillWithInitPattern	();
+		void				setProgramMemoryPtr	(TWord* _p);
+		void				detachSharedProgramMemory();
 		void				memTranslateAddress	(EMemArea& _area, TWord& _addr) const;
 	};
 }
@@ -6,6 +6,7 @@
 #include "opcodetypes.h"
 #include "types.h"
 #include "peripherals.h"
+#include "registers.h"
 
 namespace dsp56k
 {
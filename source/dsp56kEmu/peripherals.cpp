@@ -5,6 +5,7 @@
 #include "dsp.h"
 #include "hi08.h"
 #include "logging.h"
+#include "snapshot.h"
 
 namespace dsp56k
 {
@@ -16,6 +17,18 @@ namespace dsp56k
 		, m_essi(*this)
 	{
 		m_mem[XIO_IDR - XIO_Reserved_High_First] = 0x001362;
+
+		// everything that is not handled explicitly in read() / write() is plain storage
+		for(TWord a = XIO_Reserved_High_First; a <= XIO_Reserved_High_Last; ++a)
+			setRegisterAccess(a, PeriphAccessReadWrite);
+
+		setRegisterAccess(HI08::HSR, PeriphAccessCall);
+		setRegisterAccess(HI08::HRX, PeriphAccessCall);
+		setRegisterAccess(Essi::ESSI0_RX, PeriphAccessCall);
+		setRegisterAccess(Essi::ESSI0_SSISR, PeriphAccessCall);
+		setRegisterAccess(Essi::ESSI0_TX0, PeriphAccessRead);
+		setRegisterAccess(Essi::ESSI0_TX1, PeriphAccessRead);
+		setRegisterAccess(Essi::ESSI0_TX2, PeriphAccessRead);
 	}
 
 	TWord Peripherals56303::read(TWord _addr, Instruction _inst)
@@ -74,8 +87,24 @@ namespace dsp56k
 		m_hi08.reset();
 	}
 
+	void Peripherals56303::saveState(SnapshotWriter& _writer)
+	{
+		_writer.write(m_mem);
+		m_essi.saveState(_writer);
+		m_hi08.saveState(_writer);
+	}
+
+	bool Peripherals56303::loadState(SnapshotReader& _reader)
+	{
+		_reader.read(m_mem);
+		return m_essi.loadState(_reader) && m_hi08.loadState(_reader);
+	}
+
 	Peripherals56362::Peripherals56362() : m_mem(0), m_esai(*this), m_hdi08(*this), m_timers(*this), m_disableTimers(false)
 	{
+		// Registers that are plain storage. Other registers that end up in m_mem are logged on access and are not listed here to keep that
+		for(const TWord a : {static_cast<TWord>(XIO_IPRP), static_cast<TWord>(XIO_IPRC), static_cast<TWord>(M_AAR0), static_cast<TWord>(M_AAR1), static_cast<TWord>(M_AAR2), static_cast<TWord>(M_AAR3), 0xffffd5u})
+			setRegisterAccess(a, PeriphAccessReadWrite);
 	}
 
 	TWord Peripherals56362::read(TWord _addr, Instruction _inst)
@@ -238,6 +267,48 @@ namespace dsp56k
 	{
 	}
 
+	TWord Peripherals56362::getInstructionsUntilNextEvent() const
+	{
+		const auto esai = m_esai.getInstructionsUntilNextEvent();
+		const auto timers = m_disableTimers ? 0 : m_timers.getInstructionsUntilNextEvent();
+
+		if(!esai)
+			return timers;
+		if(!timers)
+			return esai;
+		return std::min(esai, timers);
+	}
+
+	bool Peripherals56362::waitForInput(const std::chrono::microseconds _timeout)
+	{
+		return m_hdi08.waitForInput(_timeout);
+	}
+
+	void Peripherals56362::wakeUp()
+	{
+		m_hdi08.wakeUp();
+	}
+
+	bool Peripherals56362::isSideEffectFreeRead(const TWord _addr) const
+	{
+		// status and control registers that are computed by read(). Data registers such as HORX or the ESAI receivers consume data when being read
+		// and the ESAI status register arms the clearing of its flags
+		switch (_addr)
+		{
+		case HDI08::HSR:
+		case HDI08::HCR:
+		case HDI08::HPCR:
+		case Esai::M_RCR:
+		case Esai::M_TCR:
+		case Timers::M_TCSR0:
+		case Timers::M_TCSR1:
+		case Timers::M_TCSR2:
+			return true;
+		default:
+			return IPeripherals::isSideEffectFreeRead(_addr);
+		}
+	}
+
 	void Peripherals56362::setSymbols(Disassembler& _disasm)
 	{
 		constexpr std::pair<int,const char*> symbols[] =
@@ -355,4 +426,18 @@ namespace dsp56k
 
 		m_esai.terminate();
 	}
+
+	void Peripherals56362::saveState(SnapshotWriter& _writer)
+	{
+		_writer.write(m_mem);
+		m_esai.saveState(_writer);
+		m_hdi08.saveState(_writer);
+		m_timers.saveState(_writer);
+	}
+
+	bool Peripherals56362::loadState(SnapshotReader& _reader)
+	{
+		_reader.read(m_mem);
+		return m_esai.loadState(_reader) && m_hdi08.loadState(_reader) && m_timers.loadState(_reader);
+	}
 }
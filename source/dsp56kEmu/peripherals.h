@@ -1,5 +1,8 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+
 #include "esai.h"
 #include "essi.h"
 #include "hdi08.h"
@@ -12,6 +15,8 @@
 namespace dsp56k
 {
 	class Disassembler;
+	class SnapshotReader;
+	class SnapshotWriter;
 
 	enum XIO
 	{
@@ -73,6 +78,15 @@ namespace dsp56k
 		XIO_IPRC							// Interrupt Priority Register Core
 	};
 
+	// How the JIT may access a peripheral register
+	enum PeripheralRegisterAccess : uint8_t
+	{
+		PeriphAccessCall		= 0,		// read() / write() need to be called
+		PeriphAccessRead		= 0x01,		// reading has no side effects, the value can be loaded from the register storage
+		PeriphAccessWrite		= 0x02,		// writing has no side effects, the value can be stored to the register storage
+		PeriphAccessReadWrite	= PeriphAccessRead | PeriphAccessWrite
+	};
+
 	class IPeripherals
 	{
 	public:
@@ -95,8 +109,42 @@ namespace dsp56k
 		virtual void setSymbols(Disassembler& _disasm) = 0;
 		virtual void terminate() = 0;
 
+		virtual void saveState(SnapshotWriter& _writer) = 0;
+		virtual bool loadState(SnapshotReader& _reader) = 0;
+
+		// Storage of the peripheral registers, indexed by address - XIO_Reserved_High_First. Registers that have direct access according to getRegisterAccess() live here
+		virtual TWord* getRegisterStorage() { return nullptr; }
+
+		// Number of instructions until a peripheral changes its state on its own, for example the next audio frame or timer event. 0 if nothing is scheduled
+		virtual TWord getInstructionsUntilNextEvent() const { return 0; }
+
+		// Blocks until the host sends data or the timeout expired. Called if the DSP is polling a peripheral and there is no scheduled event. Returns false if it did not block
+		virtual bool waitForInput(std::chrono::microseconds) { return false; }
+
+		// Makes a running or the next call to waitForInput() return immediately. Can be called from any thread
+		virtual void wakeUp() {}
+
+		uint8_t getRegisterAccess(const TWord _addr) const
+		{
+			if(_addr < XIO_Reserved_High_First || _addr > XIO_Reserved_High_Last)
+				return PeriphAccessCall;
+			return m_registerAccess[_addr - XIO_Reserved_High_First];
+		}
+
+		// True if reading the register has no side effects. A loop that does nothing but poll it cannot change anything until a peripheral does
+		virtual bool isSideEffectFreeRead(const TWord _addr) const { return getRegisterAccess(_addr) & PeriphAccessRead; }
+
+	protected:
+		void setRegisterAccess(const TWord _addr, const uint8_t _access)
+		{
+			m_registerAccess[_addr - XIO_Reserved_High_First] = _access;
+		}
+
 	private:
 		DSP* m_dsp = nullptr;
+
+		// register descriptor table, PeripheralRegisterAccess per register
+		std::array<uint8_t, XIO_Reserved_High_Last - XIO_Reserved_High_First + 1> m_registerAccess{};
 	};
 
 	class Peripherals56303 : public IPeripherals
@@ -125,6 +173,11 @@ namespace dsp56k
 
 		void terminate() override {};
 
+		void saveState(SnapshotWriter& _writer) override;
+		bool loadState(SnapshotReader& _reader) override;
+
+		TWord* getRegisterStorage() override { return m_mem.data(); }
+
 	private:
 		Essi m_essi;
 		HI08 m_hi08;
@@ -156,6 +209,16 @@ namespace dsp56k
 
 		void terminate() override;
 
+		void saveState(SnapshotWriter& _writer) override;
+		bool loadState(SnapshotReader& _reader) override;
+
+		TWord* getRegisterStorage() override { return m_mem.data(); }
+
+		TWord getInstructionsUntilNextEvent() const override;
+		bool waitForInput(std::chrono::microseconds _timeout) override;
+		bool isSideEffectFreeRead(TWord _addr) const override;
+		void wakeUp() override;
+
 	private:
 		Esai m_esai;
 		HDI08 m_hdi08;
@@ -0,0 +1,157 @@
+#include "programanalysis.h"
+
+#include "disasm.h"
+#include "interrupts.h"
+#include "memory.h"
+#include "opcodes.h"
+
+namespace dsp56k
+{
+	ProgramAnalysis::ProgramAnalysis(const Memory& _memory, const Opcodes& _opcodes, Disassembler& _disasm) : m_memory(_memory), m_opcodes(_opcodes), m_disasm(_disasm)
+	{
+	}
+
+	void ProgramAnalysis::addEntryPoint(const TWord _pc)
+	{
+		if(_pc < m_memory.size())
+			m_entryPoints.insert(_pc);
+
+		addPath(_pc, Loop());
+	}
+
+	void ProgramAnalysis::addVectors(const TWord _vba)
+	{
+		for(TWord pc = _vba; pc < _vba + Vba_End && pc < m_memory.size(); pc += 2)
+		{
+			// unused vectors are usually left empty
+			TWord opA, opB;
+			m_memory.getOpcode(pc, opA, opB);
+
+			if(!opA && !opB)
+				continue;
+
+			m_entryPoints.insert(pc);
+			m_vectors.insert(pc);
+
+			addPath(pc, Loop(), true);
+		}
+	}
+
+	void ProgramAnalysis::analyze()
+	{
+		while(!m_pending.empty())
+		{
+			const auto path = m_pending.back();
+			m_pending.pop_back();
+			follow(path);
+		}
+	}
+
+	bool ProgramAnalysis::decode(Op& _op, const TWord _pc) const
+	{
+		m_memory.getOpcode(_pc, _op.opA, _op.opB);
+
+		std::string disasm;
+		const auto len = m_disasm.disassemble(disasm, _op.opA, _op.opB, 0, 0, _pc);
+
+		if(len <= 0)
+			return false;
+
+		_op.len = static_cast<TWord>(len);
+		// a zero word is a nop, it would otherwise match more than one non-parallel opcode
+		_op.oi = _op.opA && Opcodes::isNonParallelOpcode(_op.opA) ? m_opcodes.findNonParallelOpcodeInfo(_op.opA) : nullptr;
+		return true;
+	}
+
+	void ProgramAnalysis::follow(const Path& _path)
+	{
+		m_blockStarts.emplace(_path.pc, _path.loop);
+
+		// a fast interrupt executes two words and returns to the interrupted code
+		const TWord pcMax = _path.fastInterrupt ? _path.pc + 2 : m_memory.size();
+
+		for(TWord pc = _path.pc; pc < pcMax;)
+		{
+			if(isReachable(pc))
+				return;
+
+			Op op;
+
+			if(!decode(op, pc))
+				return;
+
+			m_instructions.insert(pc);
+
+			const TWord next = pc + op.len;
+
+			if(op.oi)
+			{
+				const auto& oi = *op.oi;
+
+				// rep executes the next instruction multiple times in place, which is a regular fall through
+				if(oi.flag(OpFlagLoop) && !oi.flags(OpFlagRepImmediate, OpFlagRepDynamic))
+				{
+					Loop loop;
+					loop.begin = next;
+					loop.end = oi.m_extensionWordType & AbsoluteAddressExt ? op.opB : pc + signextend<int, 24>(static_cast<int>(op.opB));
+					loop.parent = _path.loop.begin;
+
+					if(hasField(oi, Field_hhhh))
+						loop.iterations = getFieldValue(oi.getInstruction(), Field_hhhh, Field_iiiiiiii, op.opA);
+
+					m_loops.emplace(loop.begin, loop);
+
+					addPath(next, loop);
+					addPath(loop.end + 1, _path.loop);
+					return;
+				}
+
+				if(oi.flag(OpFlagBranch))
+				{
+					const auto target = getBranchTarget(oi.getInstruction(), op.opA, op.opB, pc);
+
+					if(target != g_invalidAddress && target != g_dynamicAddress)
+						addPath(target, findEnclosingLoop(_path.loop, target));
+
+					// continue after conditional branches and subroutine calls. A jsr in a vector is a long interrupt which returns via rti
+					if(!_path.fastInterrupt && oi.flags(OpFlagCondition, OpFlagPushPC))
+						addPath(next, _path.loop);
+					return;
+				}
+
+				if(oi.flag(OpFlagPopPC))
+					return;
+			}
+
+			// execution continues at the loop start or after the loop, both are known already
+			if(pc == _path.loop.end)
+				return;
+
+			pc = next;
+		}
+	}
+
+	ProgramAnalysis::Loop ProgramAnalysis::findEnclosingLoop(const Loop& _loop, const TWord _pc) const
+	{
+		// innermost loop out of _loop and its parents that contains _pc
+		auto loop = _loop;
+
+		while(loop.isValid() && !loop.contains(_pc))
+		{
+			const auto it = m_loops.find(loop.parent);
+			if(it == m_loops.end())
+				return Loop();
+			loop = it->second;
+		}
+
+		return loop;
+	}
+
+	void ProgramAnalysis::addPath(const TWord _pc, const Loop& _loop, const bool _fastInterrupt/* = false*/)
+	{
+		if(_pc >= m_memory.size())
+			return;
+
+		m_pending.push_back({_pc, _loop, _fastInterrupt});
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "opcodeanalysis.h"
+#include "types.h"
+
+namespace dsp56k
+{
+	class Disassembler;
+	class Memory;
+	class Opcodes;
+	struct OpcodeInfo;
+
+	// Static control flow analysis of P memory. Starting at a set of entry points, all code that is reachable via branches with a target that is
+	// known at compile time is discovered (recursive descent). Code that is only reachable via dynamic branches such as jmp (r0) is not found
+	class ProgramAnalysis
+	{
+	public:
+		// innermost DO loop that a block is executed in. The JIT needs to know the loop end to terminate a block there
+		struct Loop
+		{
+			TWord begin = g_invalidAddress;
+			TWord end = g_invalidAddress;		// LA, address of the last instruction of the loop body
+			TWord iterations = 0;				// 0 if the loop count is not known at compile time
+			TWord parent = g_invalidAddress;	// begin of the enclosing loop, if any
+
+			bool isValid() const { return end != g_invalidAddress; }
+			bool contains(const TWord _pc) const { return isValid() && _pc >= begin && _pc <= end; }
+		};
+
+		ProgramAnalysis(const Memory& _memory, const Opcodes& _opcodes, Disassembler& _disasm);
+
+		void addEntryPoint(TWord _pc);
+
+		// adds all interrupt vectors that are not empty, including the reset vector at _vba. Vectors are fast interrupts of two words each
+		void addVectors(TWord _vba);
+
+		// follows all entry points that have been added since the last call
+		void analyze();
+
+		// addresses at which execution can enter a block, i.e. entry points, branch targets, return addresses and loop starts and ends
+		const std::map<TWord, Loop>& getBlockStarts() const { return m_blockStarts; }
+
+		// all DO loops, indexed by the address of the first instruction of the loop body
+		const std::map<TWord, Loop>& getLoops() const { return m_loops; }
+
+		const std::set<TWord>& getEntryPoints() const { return m_entryPoints; }
+		bool isVector(const TWord _pc) const { return m_vectors.find(_pc) != m_vectors.end(); }
+
+		bool isReachable(TWord _pc) const { return m_instructions.find(_pc) != m_instructions.end(); }
+		size_t getInstructionCount() const { return m_instructions.size(); }
+
+		struct Op
+		{
+			TWord opA = 0;
+			TWord opB = 0;
+			TWord len = 0;
+			const OpcodeInfo* oi = nullptr;		// nullptr for parallel instructions
+		};
+
+		// returns false if the op at _pc is not a valid instruction
+		bool decode(Op& _op, TWord _pc) const;
+
+	private:
+		struct Path
+		{
+			TWord pc;
+			Loop loop;
+			bool fastInterrupt;
+		};
+
+		void follow(const Path& _path);
+		Loop findEnclosingLoop(const Loop& _loop, TWord _pc) const;
+		void addPath(TWord _pc, const Loop& _loop, bool _fastInterrupt = false);
+
+		const Memory& m_memory;
+		const Opcodes& m_opcodes;
+		Disassembler& m_disasm;
+
+		std::vector<Path> m_pending;
+		std::map<TWord, Loop> m_blockStarts;
+		std::map<TWord, Loop> m_loops;
+		std::set<TWord> m_entryPoints;
+		std::set<TWord> m_vectors;
+		std::set<TWord> m_instructions;
+	};
+}
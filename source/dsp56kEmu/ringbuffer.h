@@ -4,6 +4,8 @@
 #include <array>
 #include <atomic>
 #include <thread>
+#include <type_traits>
+#include <utility>
 
 #include "dspassert.h"
 
@@ -41,13 +43,29 @@ namespace dsp56k
 			m_readSem.notify();
 		}
 
+		void push_back( T&& _val )
+		{
+			m_writeSem.wait();
+
+			m_data[m_insertPos] = std::move(_val);
+			updateCounter(m_insertPos);
+
+			++m_usage;
+
+			m_readSem.notify();
+		}
+
 		T pop_front()
 		{
 			m_readSem.wait();
 
-			T res = front();
+			T res = std::move(front());
 	//		assert( m_usage > 0 && "ring buffer is already empty!" );
 
+			// do not keep resources alive in a free slot until it is overwritten
+			if constexpr(!std::is_trivially_destructible<T>::value)
+				front() = T();
+
 			updateCounter(m_removePos);
 
 			--m_usage;
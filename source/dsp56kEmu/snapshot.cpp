@@ -0,0 +1,244 @@
+#include "snapshot.h"
+
+#include <algorithm>
+
+#include "dsp.h"
+#include "memory.h"
+
+namespace dsp56k
+{
+	namespace
+	{
+		constexpr uint32_t g_snapshotMagic = 0x53503644;	// "D6PS"
+
+		bool isZero(const TWord* _data, const TWord _count)
+		{
+			for(TWord i=0; i<_count; ++i)
+			{
+				if(_data[i])
+					return false;
+			}
+			return true;
+		}
+
+		template<typename T> bool writeFile(FILE* _file, const T* _data, const size_t _count)
+		{
+			return fwrite(_data, sizeof(T), _count, _file) == _count;
+		}
+
+		template<typename T> bool readFile(FILE* _file, T* _data, const size_t _count)
+		{
+			return fread(_data, sizeof(T), _count, _file) == _count;
+		}
+	}
+
+	bool Snapshot::create(DSP& _dsp)
+	{
+		m_state.clear();
+
+		SnapshotWriter w(m_state);
+
+		if(!_dsp.saveState(w))
+		{
+			m_state.clear();
+			return false;
+		}
+
+		const auto& mem = _dsp.memory();
+		std::vector<bool> committed;
+
+		for(size_t a=0; a<MemArea_COUNT; ++a)
+		{
+			const auto area = static_cast<EMemArea>(a);
+			const auto size = mem.size(area);
+			const TWord* src = mem.getMemAreaPtr(area);
+
+			m_memSizes[a] = size;
+
+			auto& pages = m_memPages[a];
+			pages.clear();
+
+			// pages that have never been touched are zero, scanning them would cost far more than everything else
+			mem.getCommittedPages(committed, area, PageSize);
+
+			for(TWord offset = 0; offset < size; offset += PageSize)
+			{
+				const auto count = std::min(PageSize, size - offset);
+
+				if(!committed[offset / PageSize] || isZero(src + offset, count))
+					continue;
+
+				pages.push_back({offset, std::vector<TWord>(src + offset, src + offset + count)});
+			}
+		}
+		return true;
+	}
+
+	bool Snapshot::restore(DSP& _dsp) const
+	{
+		if(m_state.empty())
+			return false;
+
+		auto& mem = _dsp.memory();
+
+		for(size_t a=0; a<MemArea_COUNT; ++a)
+		{
+			if(m_memSizes[a] != mem.size(static_cast<EMemArea>(a)))
+			{
+				LOG("Snapshot memory size mismatch for area " << a << ", snapshot size " << HEX(m_memSizes[a]) << ", memory size " << HEX(mem.size(static_cast<EMemArea>(a))));
+				return false;
+			}
+		}
+
+		// The state is validated while it is read. Peripherals apply their state while reading, keep the current one to be able to go back
+		std::vector<uint8_t> backup;
+		SnapshotWriter w(backup);
+
+		if(!_dsp.saveState(w))
+			return false;
+
+		SnapshotReader r(m_state);
+
+		if(!_dsp.loadState(r) || !r.eof())
+		{
+			LOG("Snapshot state is invalid or does not match the DSP configuration");
+
+			SnapshotReader rBackup(backup);
+			_dsp.loadState(rBackup);
+			return false;
+		}
+
+		std::vector<bool> committed;
+
+		for(size_t a=0; a<MemArea_COUNT; ++a)
+		{
+			const auto area = static_cast<EMemArea>(a);
+			const auto size = m_memSizes[a];
+
+			// pages that have never been touched are zero already, no need to read them
+			mem.getCommittedPages(committed, area, PageSize);
+
+			auto itPage = m_memPages[a].begin();
+
+			for(TWord offset = 0; offset < size; offset += PageSize)
+			{
+				const auto count = std::min(PageSize, size - offset);
+
+				if(itPage != m_memPages[a].end() && itPage->offset == offset)
+				{
+					mem.restore(area, offset, itPage->data.data(), count);
+					++itPage;
+				}
+				else if(committed[offset / PageSize])
+				{
+					mem.restore(area, offset, nullptr, count);
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool Snapshot::save(FILE* _file) const
+	{
+		const uint32_t header[] = {g_snapshotMagic, Version, static_cast<uint32_t>(m_state.size())};
+
+		if(!writeFile(_file, header, std::size(header)) || !writeFile(_file, m_state.data(), m_state.size()))
+			return false;
+
+		for(size_t a=0; a<MemArea_COUNT; ++a)
+		{
+			const auto& pages = m_memPages[a];
+
+			const uint32_t areaHeader[] = {m_memSizes[a], static_cast<uint32_t>(pages.size())};
+
+			if(!writeFile(_file, areaHeader, std::size(areaHeader)))
+				return false;
+
+			for (const auto& page : pages)
+			{
+				const uint32_t pageHeader[] = {page.offset, static_cast<uint32_t>(page.data.size())};
+
+				if(!writeFile(_file, pageHeader, std::size(pageHeader)) || !writeFile(_file, page.data.data(), page.data.size()))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	bool Snapshot::load(FILE* _file)
+	{
+		// keep this snapshot unchanged if the file turns out to be invalid
+		Snapshot s;
+
+		if(!s.loadData(_file))
+			return false;
+
+		*this = std::move(s);
+		return true;
+	}
+
+	bool Snapshot::loadData(FILE* _file)
+	{
+		uint32_t header[3];
+
+		if(!readFile(_file, header, std::size(header)))
+			return false;
+
+		if(header[0] != g_snapshotMagic)
+		{
+			LOG("Not a DSP snapshot");
+			return false;
+		}
+
+		if(header[1] != Version)
+		{
+			LOG("Snapshot version " << header[1] << " is not supported, expected version " << Version);
+			return false;
+		}
+
+		m_state.resize(header[2]);
+
+		if(!readFile(_file, m_state.data(), m_state.size()))
+			return false;
+
+		for(size_t a=0; a<MemArea_COUNT; ++a)
+		{
+			uint32_t areaHeader[2];
+
+			if(!readFile(_file, areaHeader, std::size(areaHeader)))
+				return false;
+
+			m_memSizes[a] = areaHeader[0];
+
+			auto& pages = m_memPages[a];
+			pages.resize(areaHeader[1]);
+
+			TWord minOffset = 0;
+
+			for (auto& page : pages)
+			{
+				uint32_t pageHeader[2];
+
+				if(!readFile(_file, pageHeader, std::size(pageHeader)))
+					return false;
+
+				// pages need to be sorted and complete, see restore()
+				if(pageHeader[0] % PageSize || pageHeader[0] < minOffset || pageHeader[0] >= m_memSizes[a] || pageHeader[1] != std::min(PageSize, m_memSizes[a] - pageHeader[0]))
+				{
+					LOG("Invalid memory page in snapshot at offset " << HEX(pageHeader[0]));
+					return false;
+				}
+
+				page.offset = pageHeader[0];
+				page.data.resize(pageHeader[1]);
+
+				minOffset = page.offset + PageSize;
+
+				if(!readFile(_file, page.data.data(), page.data.size()))
+					return false;
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "ringbuffer.h"
+#include "types.h"
+
+namespace dsp56k
+{
+	class DSP;
+
+	class SnapshotWriter
+	{
+	public:
+		explicit SnapshotWriter(std::vector<uint8_t>& _data) : m_data(_data) {}
+
+		void write(const void* _src, const size_t _size)
+		{
+			const auto* src = static_cast<const uint8_t*>(_src);
+			m_data.insert(m_data.end(), src, src + _size);
+		}
+
+		template<typename T> void write(const T& _value)
+		{
+			static_assert(std::is_standard_layout<T>::value && !std::is_pointer<T>::value, "type cannot be written as raw data");
+			write(&_value, sizeof(T));
+		}
+
+		template<typename T, size_t C, bool L> void write(RingBuffer<T, C, L>& _buffer)
+		{
+			const auto count = static_cast<uint32_t>(_buffer.size());
+			write(count);
+			for(uint32_t i=0; i<count; ++i)
+				write(_buffer[i]);
+		}
+
+	private:
+		std::vector<uint8_t>& m_data;
+	};
+
+	class SnapshotReader
+	{
+	public:
+		explicit SnapshotReader(const std::vector<uint8_t>& _data) : m_data(_data) {}
+
+		bool read(void* _dst, const size_t _size)
+		{
+			if(m_readPos + _size > m_data.size())
+			{
+				m_error = true;
+				return false;
+			}
+			memcpy(_dst, &m_data[m_readPos], _size);
+			m_readPos += _size;
+			return true;
+		}
+
+		template<typename T> bool read(T& _value)
+		{
+			static_assert(std::is_standard_layout<T>::value && !std::is_pointer<T>::value, "type cannot be read as raw data");
+			return read(&_value, sizeof(T));
+		}
+
+		template<typename T, size_t C, bool L> bool read(RingBuffer<T, C, L>& _buffer)
+		{
+			uint32_t count = 0;
+			if(!read(count) || count > C)
+			{
+				m_error = true;
+				return false;
+			}
+
+			_buffer.clear();
+
+			for(uint32_t i=0; i<count; ++i)
+			{
+				T v;
+				if(!read(v))
+					return false;
+				_buffer.push_back(v);
+			}
+			return true;
+		}
+
+		bool hasError() const { return m_error; }
+		bool eof() const { return m_readPos == m_data.size(); }
+
+	private:
+		const std::vector<uint8_t>& m_data;
+		size_t m_readPos = 0;
+		bool m_error = false;
+	};
+
+	// Full emulator state: DSP registers, interrupts, peripherals and memory.
+	// Memory is stored in pages, pages that are zero are not stored at all. With sparse memory, pages that have never been touched are
+	// skipped without reading them. When restoring, only pages that differ from the current memory content are written, JIT code is
+	// only discarded for program memory that changed
+	class Snapshot
+	{
+	public:
+		static constexpr uint32_t Version = 1;
+		static constexpr TWord PageSize = 1024;	// in words
+
+		bool create(DSP& _dsp);
+
+		// The DSP is left unchanged if the snapshot cannot be restored
+		bool restore(DSP& _dsp) const;
+
+		bool save(FILE* _file) const;
+		bool load(FILE* _file);
+
+		bool empty() const { return m_state.empty(); }
+
+	private:
+		bool loadData(FILE* _file);
+
+		struct Page
+		{
+			TWord offset;
+			std::vector<TWord> data;
+		};
+
+		std::vector<uint8_t> m_state;
+		std::array<TWord, MemArea_COUNT> m_memSizes{};
+		std::array<std::vector<Page>, MemArea_COUNT> m_memPages;
+	};
+}
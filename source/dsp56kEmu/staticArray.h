@@ -31,6 +31,9 @@ public:
 
 	inline bool			isValidIndex	(size_t _i) const	{ return _i < C;												}
 
+	inline T*			data			()					{ return m_array;												}
+	inline const T*		data			() const			{ return m_array;												}
+
 	void				fill			( const T& _val )
 	{
 		for( size_t i=0; i<C; i++ )
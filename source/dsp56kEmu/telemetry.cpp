@@ -0,0 +1,72 @@
+#include "telemetry.h"
+
+namespace dsp56k
+{
+	Telemetry::Values Telemetry::read() const
+	{
+		Values v;
+
+		v.time = std::chrono::steady_clock::now();
+
+		for(size_t i=0; i<m_counters.size(); ++i)
+			v.counters[i] = m_counters[i].load(std::memory_order_relaxed);
+
+		for(size_t h=0; h<m_histograms.size(); ++h)
+		{
+			for(size_t i=0; i<HistogramBuckets; ++i)
+				v.histograms[h][i] = m_histograms[h][i].load(std::memory_order_relaxed);
+		}
+
+		return v;
+	}
+
+	uint32_t Telemetry::bucket(uint64_t _value)
+	{
+		uint32_t b = 0;
+
+		while(_value && b < HistogramBuckets - 1)
+		{
+			_value >>= 1;
+			++b;
+		}
+
+		return b;
+	}
+
+	TelemetryExporter::TelemetryExporter(const Telemetry& _telemetry, const std::chrono::milliseconds _interval, Func _func)
+		: m_telemetry(_telemetry)
+		, m_interval(_interval)
+		, m_func(std::move(_func))
+	{
+		m_thread.reset(new std::thread([this]
+		{
+			threadFunc();
+		}));
+	}
+
+	TelemetryExporter::~TelemetryExporter()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_exit = true;
+		}
+
+		m_cv.notify_one();
+
+		m_thread->join();
+		m_thread.reset();
+	}
+
+	void TelemetryExporter::threadFunc()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		while(!m_exit)
+		{
+			if(m_cv.wait_for(lock, m_interval, [this] { return m_exit; }))
+				break;
+
+			m_func(m_telemetry.read());
+		}
+	}
+}
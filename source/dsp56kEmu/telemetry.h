@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace dsp56k
+{
+	enum class TelemetryCounter : uint32_t
+	{
+		Instructions,			// executed instructions including IdleInstructions, updated by DSPThread and DSPScheduler
+		JitBlocksCompiled,
+		JitCompileTimeNs,
+		Interrupts,				// executed interrupts
+		AudioUnderruns,			// DSP read audio input before the host provided it
+		DispatcherExits,		// returns from JIT code to the C++ dispatcher
+		IdleInstructions,		// instructions skipped because the DSP was polling a peripheral in an idle loop
+
+		Count
+	};
+
+	enum class TelemetryHistogram : uint32_t
+	{
+		KiloInstructionsPerSecond,
+		JitCompileTimeUs,
+
+		Count
+	};
+
+	// Lock-free performance counters. Writing never blocks, values can be read from any thread at any time
+	class Telemetry
+	{
+	public:
+		// bucket 0 holds zeroes, bucket n holds values in the range [2^(n-1), 2^n)
+		static constexpr uint32_t HistogramBuckets = 40;
+
+		using Histogram = std::array<uint64_t, HistogramBuckets>;
+
+		struct Values
+		{
+			std::array<uint64_t, static_cast<size_t>(TelemetryCounter::Count)> counters{};
+			std::array<Histogram, static_cast<size_t>(TelemetryHistogram::Count)> histograms{};
+			std::chrono::steady_clock::time_point time;	// when the values have been read
+
+			uint64_t get(TelemetryCounter _counter) const { return counters[static_cast<size_t>(_counter)]; }
+			const Histogram& get(TelemetryHistogram _histogram) const { return histograms[static_cast<size_t>(_histogram)]; }
+		};
+
+		// Only one thread is allowed to write a counter/histogram, usually the DSP thread. This avoids atomic read-modify-write operations
+		void add(const TelemetryCounter _counter, const uint64_t _value = 1)
+		{
+			auto& c = m_counters[static_cast<size_t>(_counter)];
+			c.store(c.load(std::memory_order_relaxed) + _value, std::memory_order_relaxed);
+		}
+
+		void record(const TelemetryHistogram _histogram, const uint64_t _value)
+		{
+			auto& b = m_histograms[static_cast<size_t>(_histogram)][bucket(_value)];
+			b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		uint64_t get(const TelemetryCounter _counter) const
+		{
+			return m_counters[static_cast<size_t>(_counter)].load(std::memory_order_relaxed);
+		}
+
+		Values read() const;
+
+		static uint32_t bucket(uint64_t _value);
+
+	private:
+		std::array<std::atomic<uint64_t>, static_cast<size_t>(TelemetryCounter::Count)> m_counters{};
+		std::array<std::array<std::atomic<uint64_t>, HistogramBuckets>, static_cast<size_t>(TelemetryHistogram::Count)> m_histograms{};
+	};
+
+	// Periodically calls a function with the current telemetry values from a background thread
+	class TelemetryExporter
+	{
+	public:
+		using Func = std::function<void(const Telemetry::Values&)>;
+
+		TelemetryExporter(const Telemetry& _telemetry, std::chrono::milliseconds _interval, Func _func);
+		~TelemetryExporter();
+
+		TelemetryExporter(const TelemetryExporter&) = delete;
+		TelemetryExporter& operator = (const TelemetryExporter&) = delete;
+
+	private:
+		void threadFunc();
+
+		const Telemetry& m_telemetry;
+		const std::chrono::milliseconds m_interval;
+		const Func m_func;
+
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		bool m_exit = false;
+
+		std::unique_ptr<std::thread> m_thread;
+	};
+}
@@ -3,6 +3,7 @@
 #include "dsp.h"
 
 #include "timers.h"
+#include "snapshot.h"
 
 namespace dsp56k
 {
@@ -59,4 +60,65 @@ namespace dsp56k
 			_t.m_tcr = _t.m_tlr;
 		}
 	}
+
+	TWord Timers::getInstructionsUntilNextEvent() const
+	{
+		const auto clock = m_peripherals.getDSP().getInstructionCounter();
+		const auto pending = delta(clock, m_lastClock);
+
+		TWord result = 0;
+
+		for (const auto& t : m_timers)
+		{
+			if (!t.m_tcsr.test(Timer::M_TE))
+				continue;
+
+			// the counter is incremented first and compared afterwards, a distance of zero means a full wrap around
+			auto untilCompare = (t.m_tcpr - t.m_tcr) & 0xffffff;
+			if (!untilCompare)
+				untilCompare = 0x1000000;
+			const auto untilOverflow = 0x1000000 - t.m_tcr;
+
+			const auto next = std::min(untilCompare, untilOverflow);
+
+			const TWord instructions = next > pending ? next - pending : 1;
+
+			if (!result || instructions < result)
+				result = instructions;
+		}
+
+		return result;
+	}
+
+	void Timers::saveState(SnapshotWriter& _writer) const
+	{
+		_writer.write(m_tplr);
+		_writer.write(m_tpcr);
+		_writer.write(m_lastClock);
+
+		for (const auto& t : m_timers)
+		{
+			_writer.write(t.m_tlr);
+			_writer.write(t.m_tcpr);
+			_writer.write(t.m_tcr);
+			_writer.write(t.m_tcsr);
+		}
+	}
+
+	bool Timers::loadState(SnapshotReader& _reader)
+	{
+		_reader.read(m_tplr);
+		_reader.read(m_tpcr);
+		_reader.read(m_lastClock);
+
+		for (auto& t : m_timers)
+		{
+			_reader.read(t.m_tlr);
+			_reader.read(t.m_tcpr);
+			_reader.read(t.m_tcr);
+			_reader.read(t.m_tcsr);
+		}
+
+		return !_reader.hasError();
+	}
 }
@@ -8,6 +8,8 @@ namespace dsp56k
 {
 	class Timers;
 	class IPeripherals;
+	class SnapshotReader;
+	class SnapshotWriter;
 
 	class Timer
 	{
@@ -86,6 +88,9 @@ namespace dsp56k
 		void exec();
 		void execTimer(Timer& _t, uint32_t _index) const;
 
+		// instructions until the next compare or overflow event of any enabled timer, 0 if all timers are disabled
+		TWord getInstructionsUntilNextEvent() const;
+
 		void writeTCSR(int _index, TWord _val)
 		{
 //			LOG("Write Timer " << _index << " TCSR: " << HEX(_val));
@@ -102,12 +107,12 @@ namespace dsp56k
 			t.m_tcsr = _val;
 		}
 		
-		void writeTLR(int _index, TWord _val)		{ m_timers[_index].m_tlr = _val;	LOG("Write Timer " << _index << " TLR: " << HEX(_val)); }
+		void writeTLR(int _index, TWord _val)		{ m_timers[_index].m_tlr = _val;	LOGB_INFO("Write Timer %d TLR: %06x", _index, _val); }
 		void writeTCPR(int _index, TWord _val)		{ m_timers[_index].m_tcpr = _val;	}//LOG("Write Timer " << _index << " TCPR: " << HEX(_val)); }
-		void writeTCR(int _index, TWord _val)		{ m_timers[_index].m_tcr = _val;	LOG("Write Timer " << _index << " TCR: " << HEX(_val)); }
+		void writeTCR(int _index, TWord _val)		{ m_timers[_index].m_tcr = _val;	LOGB_INFO("Write Timer %d TCR: %06x", _index, _val); }
 
-		void writeTPLR(TWord _val)					{ m_tplr = _val;					LOG("Write Timer TPLR " << ": " << HEX(_val)); }
-		void writeTPCR(TWord _val)					{ m_tpcr = _val;					LOG("Write Timer TPCR " << ": " << HEX(_val)); }
+		void writeTPLR(TWord _val)					{ m_tplr = _val;					LOGB_INFO("Write Timer TPLR: %06x", _val); }
+		void writeTPCR(TWord _val)					{ m_tpcr = _val;					LOGB_INFO("Write Timer TPCR: %06x", _val); }
 
 		TWord readTCSR(int _index)					{ return m_timers[_index].m_tcsr; }
 		TWord readTLR(int _index)					{ return m_timers[_index].m_tlr; }
@@ -117,6 +122,9 @@ namespace dsp56k
 		TWord readTPLR()							{ return m_tplr; }
 		TWord readTPCR()							{ return m_tpcr; }
 
+		void saveState(SnapshotWriter& _writer) const;
+		bool loadState(SnapshotReader& _reader);
+
 	private:
 		template<Timer::TcsrBits B> static void timerFlagReset(const Bitfield<unsigned, Timer::TcsrBits, 22>& _tcsr, TWord& _val)
 		{
@@ -0,0 +1,495 @@
+#include "tracerecorder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+
+#include "dsp.h"
+#include "logging.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace dsp56k
+{
+	namespace
+	{
+		constexpr uint32_t regSize(const size_t _reg)
+		{
+			return _reg <= static_cast<size_t>(TraceReg::Y) ? 6 : (_reg <= static_cast<size_t>(TraceReg::B) ? 7 : 3);
+		}
+
+		constexpr uint32_t regSetSize()
+		{
+			uint32_t size = 0;
+			for(size_t i=0; i<static_cast<size_t>(TraceReg::Count); ++i)
+				size += regSize(i);
+			return size;
+		}
+
+		void writeBytes(uint8_t*& _dst, const uint64_t _value, const uint32_t _count)
+		{
+			for(uint32_t i=0; i<_count; ++i)
+				*_dst++ = static_cast<uint8_t>(_value >> (i<<3));
+		}
+
+		uint64_t readBytes(const uint8_t*& _src, const uint32_t _count)
+		{
+			uint64_t res = 0;
+			for(uint32_t i=0; i<_count; ++i)
+				res |= static_cast<uint64_t>(*_src++) << (i<<3);
+			return res;
+		}
+
+		void writeVarint(uint8_t*& _dst, uint64_t _value)
+		{
+			while(_value >= 0x80)
+			{
+				*_dst++ = static_cast<uint8_t>(_value | 0x80);
+				_value >>= 7;
+			}
+			*_dst++ = static_cast<uint8_t>(_value);
+		}
+
+		uint64_t readVarint(const uint8_t*& _src)
+		{
+			uint64_t res = 0;
+			uint32_t shift = 0;
+
+			while(true)
+			{
+				const auto b = *_src++;
+				res |= static_cast<uint64_t>(b & 0x7f) << shift;
+				if(!(b & 0x80) || shift >= 63)
+					return res;
+				shift += 7;
+			}
+		}
+
+		// register values are stored unsigned and masked to their size
+		uint64_t maskReg(const size_t _reg, const int64_t _value)
+		{
+			return static_cast<uint64_t>(_value) & ((1ull << (regSize(_reg) << 3)) - 1);
+		}
+	}
+
+	const char* getTraceRegName(const TraceReg _reg)
+	{
+		static constexpr const char* names[] =
+		{
+			"x", "y", "a", "b",
+			"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+			"n0", "n1", "n2", "n3", "n4", "n5", "n6", "n7",
+			"m0", "m1", "m2", "m3", "m4", "m5", "m6", "m7",
+			"sr", "omr", "la", "lc", "sp", "sc", "sz", "vba", "ep"
+		};
+
+		static_assert(std::size(names) == static_cast<size_t>(TraceReg::Count), "register name missing");
+
+		return _reg < TraceReg::Count ? names[static_cast<size_t>(_reg)] : "?";
+	}
+
+	// _____________________________________________________________________________
+	// TraceRecorder
+	//
+	TraceRecorder::TraceRecorder(const std::string& _filename, const uint32_t _chunkSize) : m_chunkSize(std::max(_chunkSize & ~0xffffu, 0x10000u))
+	{
+#ifdef _WIN32
+		const auto file = CreateFileA(_filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if(file == INVALID_HANDLE_VALUE)
+		{
+			LOG("Failed to create trace file " << _filename);
+			return;
+		}
+		m_file = file;
+#else
+		m_file = ::open(_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if(m_file < 0)
+		{
+			LOG("Failed to create trace file " << _filename << ", error " << errno);
+			return;
+		}
+#endif
+		// the first chunk is mapped right away so that isValid() reports mapping errors
+		if(!mapChunk(0))
+			LOG("Failed to map trace file " << _filename);
+	}
+
+	TraceRecorder::~TraceRecorder()
+	{
+		endChunk();
+		unmapChunk();
+
+		// cut the file to the used size of the last chunk
+#ifdef _WIN32
+		if(m_file)
+		{
+			LARGE_INTEGER size;
+			size.QuadPart = static_cast<LONGLONG>(m_fileSize);
+			SetFilePointerEx(m_file, size, nullptr, FILE_BEGIN);
+			SetEndOfFile(m_file);
+			CloseHandle(m_file);
+		}
+#else
+		if(m_file >= 0)
+		{
+			if(ftruncate(m_file, static_cast<off_t>(m_fileSize)) != 0)
+				LOG("Failed to truncate trace file, error " << errno);
+			::close(m_file);
+		}
+#endif
+	}
+
+	void TraceRecorder::record(const DSP& _dsp, const TWord _pc, const TWord _opA, const TWord _opB, const TWord _opLen)
+	{
+		write(_dsp, 0, _pc, 1, 0, _opA, _opB, _opLen);
+	}
+
+	void TraceRecorder::recordBlock(const DSP& _dsp, const TWord _pc, const uint32_t _instructions, const TWord _lastOpOffset, const TWord _opA, const TWord _opB, const TWord _opLen)
+	{
+		write(_dsp, FlagBlock, _pc, _instructions, _lastOpOffset, _opA, _opB, _opLen);
+	}
+
+	void TraceRecorder::readRegs(TraceRegs& _dst, const DSP& _dsp)
+	{
+		const auto& r = _dsp.readRegs();
+
+		_dst[static_cast<size_t>(TraceReg::X)] = r.x.var;
+		_dst[static_cast<size_t>(TraceReg::Y)] = r.y.var;
+		_dst[static_cast<size_t>(TraceReg::A)] = r.a.var;
+		_dst[static_cast<size_t>(TraceReg::B)] = r.b.var;
+
+		for(size_t i=0; i<8; ++i)
+		{
+			_dst[static_cast<size_t>(TraceReg::R0) + i] = r.r[i].var;
+			_dst[static_cast<size_t>(TraceReg::N0) + i] = r.n[i].var;
+			_dst[static_cast<size_t>(TraceReg::M0) + i] = r.m[i].var;
+		}
+
+		_dst[static_cast<size_t>(TraceReg::SR)] = _dsp.getSR().var;
+		_dst[static_cast<size_t>(TraceReg::OMR)] = r.omr.var;
+		_dst[static_cast<size_t>(TraceReg::LA)] = r.la.var;
+		_dst[static_cast<size_t>(TraceReg::LC)] = r.lc.var;
+		_dst[static_cast<size_t>(TraceReg::SP)] = r.sp.var;
+		_dst[static_cast<size_t>(TraceReg::SC)] = r.sc.var;
+		_dst[static_cast<size_t>(TraceReg::SZ)] = r.sz.var;
+		_dst[static_cast<size_t>(TraceReg::VBA)] = r.vba.var;
+		_dst[static_cast<size_t>(TraceReg::EP)] = r.ep.var;
+
+		for(size_t i=0; i<_dst.size(); ++i)
+			_dst[i] = static_cast<int64_t>(maskReg(i, _dst[i]));
+	}
+
+	void TraceRecorder::write(const DSP& _dsp, uint8_t _flags, const TWord _pc, const uint32_t _instructions, const TWord _lastOpOffset, const TWord _opA, const TWord _opB, const TWord _opLen)
+	{
+		if(!m_chunk)
+			return;
+
+		if(!m_hasChunk || m_chunkPos + MaxRecordSize > m_chunkSize)
+		{
+			if(!beginChunk(_dsp, _pc))
+				return;
+		}
+
+		TraceRegs regs;
+		readRegs(regs, _dsp);
+
+		uint64_t changed = 0;
+		for(size_t i=0; i<regs.size(); ++i)
+		{
+			if(regs[i] != m_regs[i])
+				changed |= 1ull << i;
+		}
+
+		if(_pc != m_nextPC)		_flags |= FlagPC;
+		if(_opLen > 1)			_flags |= FlagOpB;
+
+		uint8_t* p = m_chunk + m_chunkPos;
+
+		*p++ = _flags;
+
+		if(_flags & FlagPC)
+			writeBytes(p, _pc, 3);
+
+		if(_flags & FlagBlock)
+		{
+			writeVarint(p, _instructions);
+			writeVarint(p, _lastOpOffset);
+		}
+
+		writeBytes(p, _opA, 3);
+
+		if(_flags & FlagOpB)
+			writeBytes(p, _opB, 3);
+
+		writeVarint(p, changed);
+
+		for(size_t i=0; i<regs.size(); ++i)
+		{
+			if(changed & (1ull << i))
+				writeBytes(p, static_cast<uint64_t>(regs[i]), regSize(i));
+		}
+
+		m_regs = regs;
+		m_nextPC = (_pc + _lastOpOffset + _opLen) & 0xffffff;
+
+		m_chunkPos = static_cast<uint32_t>(p - m_chunk);
+		++m_recordCount;
+
+		auto* header = reinterpret_cast<TraceChunkHeader*>(m_chunk);
+		++header->recordCount;
+		header->usedSize = m_chunkPos;
+	}
+
+	bool TraceRecorder::beginChunk(const DSP& _dsp, const TWord _pc)
+	{
+		if(m_hasChunk)
+		{
+			endChunk();
+			++m_chunkIndex;
+
+			if(!mapChunk(m_chunkIndex * m_chunkSize))
+			{
+				LOG("Failed to map trace chunk " << m_chunkIndex << ", recording stopped");
+				return false;
+			}
+		}
+
+		readRegs(m_regs, _dsp);
+
+		TraceChunkHeader header;
+		header.chunkSize = m_chunkSize;
+		header.firstRecord = m_recordCount;
+		header.pc = _pc;
+
+		m_nextPC = _pc;
+
+		uint8_t* p = m_chunk + sizeof(TraceChunkHeader);
+
+		for(size_t i=0; i<m_regs.size(); ++i)
+			writeBytes(p, static_cast<uint64_t>(m_regs[i]), regSize(i));
+
+		m_chunkPos = static_cast<uint32_t>(p - m_chunk);
+		header.usedSize = m_chunkPos;
+
+		memcpy(m_chunk, &header, sizeof(header));
+
+		m_hasChunk = true;
+		return true;
+	}
+
+	void TraceRecorder::endChunk()
+	{
+		if(!m_hasChunk)
+			return;
+
+		m_fileSize = m_chunkIndex * m_chunkSize + m_chunkPos;
+	}
+
+	bool TraceRecorder::mapChunk(const uint64_t _offset)
+	{
+		unmapChunk();
+
+		const uint64_t end = _offset + m_chunkSize;
+
+#ifdef _WIN32
+		if(!m_file)
+			return false;
+
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, static_cast<DWORD>(end >> 32), static_cast<DWORD>(end), nullptr);
+		if(!m_mapping)
+			return false;
+
+		m_chunk = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, static_cast<DWORD>(_offset >> 32), static_cast<DWORD>(_offset), m_chunkSize));
+		if(!m_chunk)
+		{
+			CloseHandle(m_mapping);
+			m_mapping = nullptr;
+			return false;
+		}
+#else
+		if(m_file < 0)
+			return false;
+
+		if(ftruncate(m_file, static_cast<off_t>(end)) != 0)
+			return false;
+
+		void* p = mmap(nullptr, m_chunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, static_cast<off_t>(_offset));
+		if(p == MAP_FAILED)
+			return false;
+
+		m_chunk = static_cast<uint8_t*>(p);
+#endif
+		return true;
+	}
+
+	void TraceRecorder::unmapChunk()
+	{
+		if(!m_chunk)
+			return;
+
+#ifdef _WIN32
+		UnmapViewOfFile(m_chunk);
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+#else
+		munmap(m_chunk, m_chunkSize);
+#endif
+		m_chunk = nullptr;
+	}
+
+	// _____________________________________________________________________________
+	// TraceReader
+	//
+	TraceReader::~TraceReader()
+	{
+		close();
+	}
+
+	bool TraceReader::open(const std::string& _filename)
+	{
+		close();
+
+		m_file = fopen(_filename.c_str(), "rb");
+
+		if(!m_file)
+			return false;
+
+		return true;
+	}
+
+	void TraceReader::close()
+	{
+		if(m_file)
+			fclose(m_file);
+
+		m_file = nullptr;
+		m_chunk.clear();
+		m_chunkPos = 0;
+		m_remainingRecords = 0;
+		m_recordIndex = 0;
+	}
+
+	bool TraceReader::read(TraceEntry& _entry)
+	{
+		while(!m_remainingRecords)
+		{
+			if(!readChunk())
+				return false;
+		}
+
+		// a valid record cannot be larger than this
+		constexpr uint32_t maxRecordSize = 1 + 3 + 10 + 10 + 3 + 3 + 10 + static_cast<uint32_t>(TraceReg::Count) * 7;
+
+		std::array<uint8_t, maxRecordSize> temp{};
+		memcpy(temp.data(), &m_chunk[m_chunkPos], std::min<size_t>(maxRecordSize, m_chunk.size() - m_chunkPos));
+
+		const uint8_t* p = temp.data();
+
+		const auto flags = *p++;
+
+		_entry.pc = (flags & FlagPC) ? static_cast<TWord>(readBytes(p, 3)) : m_nextPC;
+
+		if(flags & FlagBlock)
+		{
+			_entry.instructions = static_cast<uint32_t>(readVarint(p));
+			_entry.lastOpOffset = static_cast<TWord>(readVarint(p));
+		}
+		else
+		{
+			_entry.instructions = 1;
+			_entry.lastOpOffset = 0;
+		}
+
+		_entry.opA = static_cast<TWord>(readBytes(p, 3));
+
+		if(flags & FlagOpB)
+		{
+			_entry.opB = static_cast<TWord>(readBytes(p, 3));
+			_entry.opLen = 2;
+		}
+		else
+		{
+			_entry.opB = 0;
+			_entry.opLen = 1;
+		}
+
+		_entry.changedRegs = readVarint(p);
+
+		for(size_t i=0; i<m_regs.size(); ++i)
+		{
+			if(_entry.changedRegs & (1ull << i))
+				m_regs[i] = static_cast<int64_t>(readBytes(p, regSize(i)));
+		}
+
+		_entry.regs = m_regs;
+
+		m_chunkPos += static_cast<uint32_t>(p - temp.data());
+
+		if(m_chunkPos > m_chunk.size())
+		{
+			LOG("Trace record " << m_recordIndex << " exceeds chunk size, file is corrupt");
+			m_remainingRecords = 0;
+			return false;
+		}
+
+		m_nextPC = (_entry.pc + _entry.lastOpOffset + _entry.opLen) & 0xffffff;
+
+		--m_remainingRecords;
+		++m_recordIndex;
+
+		return true;
+	}
+
+	bool TraceReader::readChunk()
+	{
+		if(!m_file)
+			return false;
+
+		TraceChunkHeader header;
+
+		if(fread(&header, sizeof(header), 1, m_file) != 1)
+			return false;
+
+		if(header.magic != TraceChunkHeader::Magic || header.version != TraceChunkHeader::Version)
+		{
+			LOG("Invalid trace chunk header");
+			return false;
+		}
+
+		if(header.usedSize < sizeof(header) + regSetSize() || header.usedSize > header.chunkSize)
+		{
+			LOG("Invalid trace chunk size " << header.usedSize);
+			return false;
+		}
+
+		m_chunk.resize(header.usedSize - sizeof(header));
+
+		if(fread(m_chunk.data(), 1, m_chunk.size(), m_file) != m_chunk.size())
+			return false;
+
+		// skip the unused space of the chunk, the last chunk has no unused space
+		if(header.usedSize < header.chunkSize)
+			fseek(m_file, static_cast<long>(header.chunkSize - header.usedSize), SEEK_CUR);
+
+		const uint8_t* p = m_chunk.data();
+
+		for(size_t i=0; i<m_regs.size(); ++i)
+			m_regs[i] = static_cast<int64_t>(readBytes(p, regSize(i)));
+
+		m_chunkPos = static_cast<uint32_t>(p - m_chunk.data());
+		m_remainingRecords = header.recordCount;
+		m_recordIndex = header.firstRecord;
+		m_nextPC = header.pc;
+
+		return true;
+	}
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace dsp56k
+{
+	class DSP;
+
+	// Registers that are tracked by the binary trace. X, Y are 48 bits wide, A, B 56 bits, everything else 24 bits
+	enum class TraceReg : uint8_t
+	{
+		X, Y, A, B,
+		R0, R1, R2, R3, R4, R5, R6, R7,
+		N0, N1, N2, N3, N4, N5, N6, N7,
+		M0, M1, M2, M3, M4, M5, M6, M7,
+		SR, OMR, LA, LC, SP, SC, SZ, VBA, EP,
+
+		Count
+	};
+
+	using TraceRegs = std::array<int64_t, static_cast<size_t>(TraceReg::Count)>;
+
+	const char* getTraceRegName(TraceReg _reg);
+
+	// The trace file is a sequence of fixed-size chunks. Every chunk starts with a header and a full register set, followed by records.
+	// Chunks can be decoded, and therefore compressed, independently of each other. The last chunk of a file is truncated to its used size.
+	//
+	// Record layout:
+	//	u8 flags (TraceRecordFlags)
+	//	u24 pc						if FlagPC is set, otherwise the pc is the pc of the previous record plus its opcode length
+	//	varint instructions, varint last op offset	if FlagBlock is set (JIT block). The opcode is the one of the last op of the block
+	//	u24 opcode word A
+	//	u24 opcode word B			if FlagOpB is set
+	//	varint register bitmask, followed by the new values of all changed registers, in order of TraceReg
+	struct TraceChunkHeader
+	{
+		static constexpr uint32_t Magic = 0x43525444;	// DTRC
+		static constexpr uint32_t Version = 1;
+
+		uint32_t magic = Magic;
+		uint32_t version = Version;
+		uint32_t chunkSize = 0;
+		uint32_t usedSize = 0;			// including header and register set
+		uint64_t firstRecord = 0;		// index of the first record in this chunk
+		uint32_t recordCount = 0;
+		uint32_t pc = 0;				// pc that is expected for the first record if it has no FlagPC
+	};
+
+	enum TraceRecordFlags : uint8_t
+	{
+		FlagPC		= 0x01,
+		FlagOpB		= 0x02,
+		FlagBlock	= 0x04,
+	};
+
+	struct TraceEntry
+	{
+		TWord pc = 0;
+		TWord opA = 0;
+		TWord opB = 0;
+		TWord opLen = 1;
+		uint32_t instructions = 1;		// number of executed instructions. Larger than one if a whole JIT block has been recorded
+		TWord lastOpOffset = 0;			// offset of the traced op relative to pc, only non-zero for JIT blocks
+		uint64_t changedRegs = 0;		// bitmask of TraceReg
+		TraceRegs regs{};
+	};
+
+	// Records every executed instruction (interpreter) or block (JIT) of a DSP into a memory-mapped file. Attach via DSP::setTraceRecorder
+	class TraceRecorder final
+	{
+	public:
+		// _chunkSize needs to be a multiple of 64k, the allocation granularity of file mappings on Windows
+		explicit TraceRecorder(const std::string& _filename, uint32_t _chunkSize = 0x400000);
+		~TraceRecorder();
+
+		TraceRecorder(const TraceRecorder&) = delete;
+		TraceRecorder& operator = (const TraceRecorder&) = delete;
+
+		bool isValid() const { return m_chunk != nullptr; }
+
+		void record(const DSP& _dsp, TWord _pc, TWord _opA, TWord _opB, TWord _opLen);
+		void recordBlock(const DSP& _dsp, TWord _pc, uint32_t _instructions, TWord _lastOpOffset, TWord _opA, TWord _opB, TWord _opLen);
+
+		uint64_t getRecordCount() const { return m_recordCount; }
+
+		static void readRegs(TraceRegs& _dst, const DSP& _dsp);
+
+	private:
+		// flags + pc + two varints + two opcode words + bitmask + all registers at maximum size
+		static constexpr uint32_t MaxRecordSize = 1 + 3 + 5 + 5 + 3 + 3 + 10 + static_cast<uint32_t>(TraceReg::Count) * 7;
+
+		void write(const DSP& _dsp, uint8_t _flags, TWord _pc, uint32_t _instructions, TWord _lastOpOffset, TWord _opA, TWord _opB, TWord _opLen);
+		bool beginChunk(const DSP& _dsp, TWord _pc);
+		void endChunk();
+		bool mapChunk(uint64_t _offset);
+		void unmapChunk();
+
+		const uint32_t m_chunkSize;
+
+		uint8_t* m_chunk = nullptr;
+		uint32_t m_chunkPos = 0;
+		uint64_t m_chunkIndex = 0;
+		uint64_t m_recordCount = 0;
+		uint64_t m_fileSize = 0;
+
+		TWord m_nextPC = 0;
+		bool m_hasChunk = false;
+		TraceRegs m_regs{};
+
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#else
+		int m_file = -1;
+#endif
+	};
+
+	// Reads a trace file that has been written by TraceRecorder
+	class TraceReader final
+	{
+	public:
+		TraceReader() = default;
+		~TraceReader();
+
+		TraceReader(const TraceReader&) = delete;
+		TraceReader& operator = (const TraceReader&) = delete;
+
+		bool open(const std::string& _filename);
+		void close();
+
+		// returns false at the end of the file or if the file is corrupt
+		bool read(TraceEntry& _entry);
+
+		uint64_t getRecordIndex() const { return m_recordIndex; }
+
+	private:
+		bool readChunk();
+
+		FILE* m_file = nullptr;
+		std::vector<uint8_t> m_chunk;
+		uint32_t m_chunkPos = 0;
+		uint32_t m_remainingRecords = 0;
+		uint64_t m_recordIndex = 0;
+		TWord m_nextPC = 0;
+		TraceRegs m_regs{};
+	};
+}
@@ -1,10 +1,23 @@
 #include "unittests.h"
 
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
 
 #include "agu.h"
+#include "controlflowgraph.h"
 #include "disasm.h"
 #include "dsp.h"
+#include "dspscheduler.h"
+#include "dspthread.h"
 #include "memory.h"
+#include "peripherals.h"
+#include "programanalysis.h"
+#include "snapshot.h"
+#include "tracerecorder.h"
 
 namespace dsp56k
 {
@@ -35,6 +48,13 @@ namespace dsp56k
 		testEXTRACTU_CO();
 		testMPY();
 		testAgu();
+		testSnapshot();
+		testTraceRecorder();
+		testPeripheralEvents();
+		testProgramAnalysis();
+		testDSPThread();
+		testSharedProgramMemory();
+		testDSPScheduler();
 
 //		testDisassembler();		// will take a few minutes in debug, so commented out for now
 	}
@@ -567,6 +587,444 @@ namespace dsp56k
 		assert(r == 0x1100);
 	}
 
+	void UnitTests::testSnapshot()
+	{
+		dsp.resetHW();
+
+		dsp.regs().a.var = 0x00123456789abc;
+		dsp.regs().r[3].var = 0x42;
+		dsp.mem.set(MemArea_X, 0x10, 0x111111);
+		dsp.mem.set(MemArea_P, 0x20, 0x222222);
+
+		Snapshot snapshot;
+		snapshot.create(dsp);
+
+		dsp.regs().a.var = 0;
+		dsp.regs().r[3].var = 0;
+		dsp.mem.set(MemArea_X, 0x10, 0);
+		dsp.mem.set(MemArea_P, 0x20, 0);
+		dsp.mem.set(MemArea_Y, 0x30, 0x333333);
+
+		if(!snapshot.restore(dsp))
+			assert(false && "failed to restore snapshot");
+
+		assert(dsp.regs().a.var == 0x00123456789abc);
+		assert(dsp.regs().r[3].var == 0x42);
+		assert(dsp.mem.get(MemArea_X, 0x10) == 0x111111);
+		assert(dsp.mem.get(MemArea_P, 0x20) == 0x222222);
+		assert(dsp.mem.get(MemArea_Y, 0x30) == 0);
+
+		// file round trip
+		const auto path = std::filesystem::temp_directory_path() / "dsp56k_unittest_snapshot.bin";
+
+		FILE* hFile = fopen(path.string().c_str(), "wb");
+		assert(hFile);
+		const auto saved = snapshot.save(hFile);
+		fclose(hFile);
+		assert(saved);
+
+		Snapshot loaded;
+		hFile = fopen(path.string().c_str(), "rb");
+		assert(hFile);
+		const auto wasLoaded = loaded.load(hFile);
+		fclose(hFile);
+		std::filesystem::remove(path);
+		assert(wasLoaded);
+
+		dsp.regs().a.var = 0;
+		dsp.mem.set(MemArea_X, 0x10, 0);
+		dsp.mem.set(MemArea_P, 0x20, 0x444444);
+
+		if(!loaded.restore(dsp))
+			assert(false && "failed to restore loaded snapshot");
+
+		assert(dsp.regs().a.var == 0x00123456789abc);
+		assert(dsp.regs().r[3].var == 0x42);
+		assert(dsp.mem.get(MemArea_X, 0x10) == 0x111111);
+		assert(dsp.mem.get(MemArea_P, 0x20) == 0x222222);
+	}
+
+	void UnitTests::testTraceRecorder()
+	{
+		dsp.resetHW();
+
+		const auto path = std::filesystem::temp_directory_path() / "dsp56k_unittest_trace.bin";
+		const auto filename = path.string();
+
+		// enough records to span multiple chunks
+		constexpr uint32_t count = 20000;
+
+		{
+			TraceRecorder recorder(filename, 0x10000);
+			assert(recorder.isValid());
+
+			for(uint32_t i=0; i<count; ++i)
+			{
+				dsp.regs().r[i & 7].var = static_cast<int32_t>(i);
+
+				// jump every 100 instructions, use a two-word op every 10 instructions
+				const TWord pc = (i / 100) * 0x1000 + (i % 100) * 2;
+				recorder.record(dsp, pc, 0x000000, 0x123456, (i % 10) ? 2 : 1);
+			}
+
+			assert(recorder.getRecordCount() == count);
+		}
+
+		TraceReader reader;
+		const auto opened = reader.open(filename);
+		assert(opened);
+
+		TraceEntry e;
+		uint32_t i = 0;
+
+		while(reader.read(e))
+		{
+			assert(e.pc == (i / 100) * 0x1000 + (i % 100) * 2);
+			assert(e.opLen == ((i % 10) ? 2u : 1u));
+			assert(e.regs[static_cast<size_t>(TraceReg::R0) + (i & 7)] == i);
+			++i;
+		}
+
+		assert(i == count);
+
+		reader.close();
+		std::filesystem::remove(path);
+	}
+
+	void UnitTests::testPeripheralEvents()
+	{
+		Peripherals56362 p;
+		Memory m(g_defaultMemoryMap, 0x100);
+		DSP d(m, &p, &p);
+
+		// nothing is running
+		assert(p.getInstructionsUntilNextEvent() == 0);
+
+		p.write(Timers::M_TCPR0, 100);
+		p.write(Timers::M_TCSR0, 1 << Timer::M_TE);
+		assert(p.getInstructionsUntilNextEvent() == 100);
+
+		// the counter is incremented before it is compared, a compare value equal to the count is reached after a full wrap around
+		p.write(Timers::M_TCR0, 100);
+		assert(p.getInstructionsUntilNextEvent() == 0x1000000 - 100);
+
+		p.write(Timers::M_TCSR0, 0);
+		assert(p.getInstructionsUntilNextEvent() == 0);
+
+		// idle loops are only detected for registers that can be polled without side effects
+		assert(p.isSideEffectFreeRead(HDI08::HSR));
+		assert(!p.isSideEffectFreeRead(HDI08::HORX));
+		assert(!p.isSideEffectFreeRead(Esai::M_RX0));
+		assert(!p.isSideEffectFreeRead(Esai::M_SAISR));
+	}
+
+	void UnitTests::testProgramAnalysis()
+	{
+		Memory m(g_defaultMemoryMap, 0x200);
+		Opcodes opcodes;
+		Disassembler disasm(opcodes);
+
+		m.set(MemArea_P, 0x000, 0x0c0100);	// reset vector: jmp $100
+		m.set(MemArea_P, 0x100, 0x0d0120);	// jsr $120
+		m.set(MemArea_P, 0x101, 0x060480);	// do #4,$105
+		m.set(MemArea_P, 0x102, 0x000104);
+		m.set(MemArea_P, 0x103, 0x0604a0);	// rep #4
+		m.set(MemArea_P, 0x104, 0x200032);	// asl a
+		m.set(MemArea_P, 0x105, 0x0c0100);	// jmp $100
+		m.set(MemArea_P, 0x106, 0x000000);	// not reachable
+		m.set(MemArea_P, 0x120, 0x00000c);	// rts
+
+		ProgramAnalysis analysis(m, opcodes, disasm);
+		analysis.addVectors(0);
+		analysis.analyze();
+
+		const auto& starts = analysis.getBlockStarts();
+
+		assert(starts.size() == 6);
+		assert(starts.count(0x000) && starts.count(0x100) && starts.count(0x101) && starts.count(0x103) && starts.count(0x105) && starts.count(0x120));
+
+		const auto& loop = starts.at(0x103);
+		assert(loop.begin == 0x103 && loop.end == 0x104);
+		assert(!starts.at(0x105).isValid());
+
+		assert(analysis.getInstructionCount() == 7);
+		assert(analysis.isReachable(0x104));
+		assert(!analysis.isReachable(0x001));
+		assert(!analysis.isReachable(0x106));
+
+		const ControlFlowGraph cfg(analysis);
+
+		const auto& blocks = cfg.getBlocks();
+		assert(blocks.size() == 6);
+
+		// rep #4 plus the repeated instruction, four loop iterations
+		const auto& body = blocks.at(0x103);
+		assert(body.instructions == 2 && body.estimatedInstructions == 20 && body.loopDepth == 1);
+		assert(body.edges.size() == 2 && body.edges[0].type == ControlFlowGraph::EdgeType::LoopBack && body.edges[1].target == 0x105);
+
+		const auto& functions = cfg.getFunctions();
+		assert(functions.size() == 2);
+		assert(functions.at(0x000).blocks.size() == 5);
+		assert(functions.at(0x000).callees.size() == 1 && functions.at(0x000).callees.count(0x120));
+
+		// a branch out of the inner loop to a target in the outer loop is executed in the outer loop
+		m.set(MemArea_P, 0x140, 0x060480);	// do #4,$149
+		m.set(MemArea_P, 0x141, 0x000148);
+		m.set(MemArea_P, 0x142, 0x060480);	// do #4,$147
+		m.set(MemArea_P, 0x143, 0x000146);
+		m.set(MemArea_P, 0x144, 0x0e0148);	// jcc $148
+		m.set(MemArea_P, 0x145, 0x000000);	// nop
+		m.set(MemArea_P, 0x146, 0x000000);	// nop
+		m.set(MemArea_P, 0x147, 0x000000);	// nop
+		m.set(MemArea_P, 0x148, 0x000000);	// nop
+		m.set(MemArea_P, 0x149, 0x00000c);	// rts
+
+		ProgramAnalysis nested(m, opcodes, disasm);
+		nested.addEntryPoint(0x140);
+		nested.analyze();
+
+		const auto& nestedStarts = nested.getBlockStarts();
+		assert(nestedStarts.at(0x144).begin == 0x144 && nestedStarts.at(0x144).parent == 0x142);
+		assert(nestedStarts.at(0x148).begin == 0x142 && nestedStarts.at(0x148).end == 0x148);
+	}
+
+	void UnitTests::testDSPThread()
+	{
+		Peripherals56362 p;
+		Memory m(g_defaultMemoryMap, 0x100);
+		DSP d(m, &p, &p);
+
+		m.set(MemArea_P, 0, 0x000000);	// nop
+		m.set(MemArea_P, 1, 0x0c0000);	// jmp $0
+		d.setPC(0);
+
+		DSPThreadConfig config;
+		config.logMips = false;
+
+		DSPThread t(d, config);
+
+		// commands are processed in order, the pause has been applied once a blocking command returns
+		t.pause();
+		t.execAtSafePointBlocking([](DSP&) {});
+
+		const auto paused = t.getStatus();
+		assert(paused.paused);
+		assert(paused.pc <= 1);
+
+		// a paused DSP does not execute anything
+		t.execAtSafePointBlocking([](DSP&) {});
+		assert(t.getStatus().instructions == paused.instructions);
+
+		t.step(10);
+		t.execAtSafePointBlocking([](DSP&) {});
+
+		const auto stepped = t.getStatus();
+		assert(stepped.paused);
+		assert(stepped.instructions >= paused.instructions + 10);
+
+		// more commands than the ring can hold, the producer has to wait for the DSP thread
+		std::vector<uint32_t> order;
+		for(uint32_t i=0; i<1000; ++i)
+			t.execAtSafePoint([&order, i](DSP&) { order.push_back(i); });
+		t.execAtSafePointBlocking([](DSP&) {});
+
+		assert(order.size() == 1000);
+		for(uint32_t i=0; i<order.size(); ++i)
+			assert(order[i] == i);
+
+		// the status is read while the DSP thread keeps publishing it
+		t.resume();
+
+		std::atomic<bool> reading{true};
+
+		std::thread reader([&]
+		{
+			uint64_t last = 0;
+			while(reading)
+			{
+				const auto s = t.getStatus();
+				assert(s.instructions >= last);
+				assert(s.pc <= 1);
+				last = s.instructions;
+			}
+		});
+
+		while(t.getStatus().instructions < stepped.instructions + 100000)
+			std::this_thread::yield();
+
+		reading = false;
+		reader.join();
+
+		assert(!t.getStatus().paused);
+
+		t.join();
+	}
+
+	void UnitTests::testSharedProgramMemory()
+	{
+		Peripherals56362 pA;
+		Peripherals56362 pB;
+		Memory mA(g_defaultMemoryMap, 0x100);
+		Memory mB(g_defaultMemoryMap, 0x100);
+		DSP a(mA, &pA, &pA);
+		DSP b(mB, &pB, &pB);
+
+		mA.set(MemArea_P, 0x00, 0x000008);	// inc a
+		mA.set(MemArea_P, 0x01, 0x0c0000);	// jmp $0
+		mA.set(MemArea_P, 0x10, 0x076084);	// move x0,p:(r0)
+		mA.set(MemArea_P, 0x11, 0x0c0000);	// jmp $0
+
+		const auto image = mA.shareProgramMemory();
+		const auto shared = mB.useSharedProgramMemory(image);
+		assert(shared);
+
+		// code that has been compiled by one DSP is executed by the other
+		if(a.useJit() && b.useJit())
+		{
+			const auto sharedCode = b.getJit().shareCodeCache(a.getJit());
+			assert(sharedCode);
+			assert(a.getJit().isCodeCacheShared());
+		}
+
+		a.setPC(0);
+		b.setPC(0);
+		a.exec(100);
+		b.exec(100);
+
+		assert(a.regs().a.var > 0);
+		assert(b.regs().a.var > 0);
+
+		// running code of A writes to P, which detaches A from the image. B keeps running the shared code
+		a.regs().x.var = 0x000009;	// inc b
+		a.regs().r[0].var = 0;
+		a.setPC(0x10);
+		a.exec(100);
+
+		assert(!mA.isProgramMemoryShared());
+		assert(mB.isProgramMemoryShared());
+		assert(mA.get(MemArea_P, 0) == 0x000009);
+		assert(mB.get(MemArea_P, 0) == 0x000008);
+		assert((*image)[0] == 0x000008);
+
+		const auto aA = a.regs().a.var;
+		const auto bA = a.regs().b.var;
+		const auto aB = b.regs().a.var;
+		const auto bB = b.regs().b.var;
+
+		assert(bA > 0);
+
+		a.exec(100);
+		b.exec(100);
+
+		assert(a.regs().a.var == aA);
+		assert(a.regs().b.var > bA);
+		assert(b.regs().a.var > aB);
+		assert(b.regs().b.var == bB);
+	}
+
+	void UnitTests::testDSPScheduler()
+	{
+		struct Instance
+		{
+			Instance() : mem(g_defaultMemoryMap, 0x100), dsp(mem, &periph, &periph)
+			{
+				mem.set(MemArea_P, 0, 0x000000);	// nop
+				mem.set(MemArea_P, 1, 0x0c0000);	// jmp $0
+				dsp.setPC(0);
+			}
+
+			uint64_t instructions() const { return dsp.getTelemetry().get(TelemetryCounter::Instructions); }
+
+			Peripherals56362 periph;
+			Memory mem;
+			DSP dsp;
+		};
+
+		auto waitFor = [](const std::function<bool()>& _condition)
+		{
+			const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+			while(!_condition())
+			{
+				if(std::chrono::steady_clock::now() > end)
+					return false;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			return true;
+		};
+
+		// work stealing. Instances are distributed round robin, a and c start on the first worker. Once b is removed, the second worker has to steal
+		{
+			Instance a, b, c;
+
+			std::mutex mutex;
+			std::set<std::thread::id> threads;
+
+			auto canRun = [&](DSP&)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				threads.insert(std::this_thread::get_id());
+				return true;
+			};
+
+			DSPScheduler scheduler(2, 1024);
+
+			scheduler.add(a.dsp, canRun);
+			scheduler.add(b.dsp, canRun);
+			scheduler.add(c.dsp, canRun);
+
+			const auto removed = scheduler.remove(b.dsp);
+			assert(removed);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				threads.clear();
+			}
+
+			const auto stolen = waitFor([&]
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				return threads.size() == 2;
+			});
+			assert(stolen);
+
+			// the instruction counter is updated for instances run by the scheduler
+			const auto running = waitFor([&] { return a.instructions() > 10000 && c.instructions() > 10000; });
+			assert(running);
+
+			scheduler.remove(a.dsp);
+			scheduler.remove(c.dsp);
+		}
+
+		// parking. The only worker is idle while the instance is parked, wakeUp() makes it check again
+		{
+			Instance a;
+
+			std::atomic<bool> canRun{false};
+			std::atomic<uint32_t> checks{0};
+
+			DSPScheduler scheduler(1, 1024);
+
+			scheduler.add(a.dsp, [&](DSP&)
+			{
+				++checks;
+				return canRun.load();
+			});
+
+			const auto checked = waitFor([&] { return checks > 0; });
+			assert(checked);
+			assert(a.instructions() == 0);
+
+			canRun = true;
+			scheduler.wakeUp();
+
+			const auto running = waitFor([&] { return a.instructions() > 10000; });
+			assert(running);
+
+			scheduler.remove(a.dsp);
+		}
+	}
+
 	void UnitTests::testDisassembler()
 	{
 #ifdef USE_MOTOROLA_UNASM
@@ -37,6 +37,13 @@ namespace dsp56k
 		void testMPY();
 
 		void testAgu();
+		void testSnapshot();
+		void testTraceRecorder();
+		void testPeripheralEvents();
+		void testProgramAnalysis();
+		void testDSPThread();
+		void testSharedProgramMemory();
+		void testDSPScheduler();
 
 		void testDisassembler();
 		
@@ -0,0 +1,419 @@
+// Differential fuzzer: executes random straight-line programs with the JIT and the interpreter and compares registers and memory.
+// Builds as a standalone executable that is run by CTest or, with DSP56K_LIBFUZZER defined, as a libFuzzer target
+
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "dsp56kEmu/disasm.h"
+#include "dsp56kEmu/dsp.h"
+#include "dsp56kEmu/memory.h"
+#include "dsp56kEmu/opcodes.h"
+#include "dsp56kEmu/peripherals.h"
+#include "dsp56kEmu/snapshot.h"
+#include "dsp56kEmu/tracerecorder.h"
+
+#ifndef DSP56K_LIBFUZZER
+#include "../disassemble/commandline.h"
+#endif
+
+using namespace dsp56k;
+
+namespace
+{
+	constexpr TWord g_memSize		= 0xffff80;	// everything below the peripheral address space
+	constexpr TWord g_dataSize		= 0x2000;	// size of the area at the start of X, Y and P that is initialized and compared
+	constexpr TWord g_addressRange	= 0x400;	// initial range of address registers and absolute addresses
+	constexpr TWord g_programStart	= 0x1000;	// out of reach for data accesses via address registers
+	constexpr uint32_t g_maxOps		= 32;
+
+	// Stores peripheral writes and returns them on read. Has no side effects so that both engines see the same values
+	class FuzzPeripherals final : public IPeripherals
+	{
+	public:
+		TWord read(const TWord _addr, Instruction) override	{ return m_mem[_addr & 0x7f]; }
+		void write(const TWord _addr, const TWord _value) override	{ m_mem[_addr & 0x7f] = _value; }
+		void exec() override {}
+		void reset() override { m_mem.fill(0); }
+		void setSymbols(Disassembler&) override {}
+		void terminate() override {}
+		void saveState(SnapshotWriter& _writer) override { _writer.write(m_mem); }
+		bool loadState(SnapshotReader& _reader) override { return _reader.read(m_mem); }
+
+	private:
+		std::array<TWord, 0x80> m_mem{};
+	};
+
+	DefaultMemoryValidator g_memoryMap;
+
+	struct Instance
+	{
+		explicit Instance(const bool _interpreterOnly) : mem(g_memoryMap, g_memSize), dsp(mem, &peripherals, &peripherals)
+		{
+			dsp.setInterpreterOnly(_interpreterOnly);
+		}
+
+		FuzzPeripherals peripherals;
+		Memory mem;
+		DSP dsp;
+	};
+
+	bool isSupported(const Instruction _inst)
+	{
+		switch (_inst)
+		{
+		// not implemented by the interpreter or the JIT
+		case ADC: case BRKcc: case Bchg_aa: case Bchg_ea: case Bchg_pp: case Bchg_qq: case Bclr_aa: case Bset_aa:
+		case Clb: case Cmpu_S1S2: case Debug: case Debugcc: case DoForever: case Dor_aa: case DorForever:
+		case Eor_SD: case Eor_xx: case Eor_xxxx: case Extract_CoS2: case Extract_S1S2: case Illegal: case Insert_CoS2: case Insert_S1S2:
+		case Lra_Rn: case Lsl_SD: case Lsr_SD: case Maci_xxxx: case Macri_xxxx: case Max: case Maxm: case Merge:
+		case Movem_aa: case Movep_eapp: case Movep_eaqq: case Mpyr_SD: case Mpyri: case Norm: case Normf: case Or_xx: case Or_xxxx:
+		case Pflush: case Pflushun: case Pfree: case Plock: case Plockr: case Punlock: case Punlockr: case Rep_aa: case Rep_ea:
+		case Ror: case Sbc: case Stop: case Subl: case Subr: case Trap: case Trapcc: case Vsl: case Wait:
+		// change the processing state in a way that is not part of the comparison or not supported (16 bit modes, stack)
+		case Andi: case Ori: case Movec_ea: case Movec_aa: case Movec_S1D2: case Movec_xx: case Enddo: case Reset: case Rti: case Rts:
+		case Ifcc: case Ifcc_U:
+			return false;
+		default:
+			return true;
+		}
+	}
+
+	bool isSupported(const OpcodeInfo& _oi)
+	{
+		// programs are straight-line code
+		if(_oi.m_flags & (OpFlagBranch | OpFlagLoop | OpFlagPopPC | OpFlagPushPC | OpFlagRepImmediate | OpFlagRepDynamic | OpFlagCacheMod))
+			return false;
+
+		return isSupported(_oi.getInstruction());
+	}
+
+	std::string hex(const uint64_t _value, const int _digits = 6)
+	{
+		char temp[32];
+		snprintf(temp, sizeof(temp), "%0*llx", _digits, static_cast<unsigned long long>(_value));
+		return temp;
+	}
+
+	class Fuzzer
+	{
+	public:
+		Fuzzer() : m_jit(false), m_interpreter(true)
+		{
+		}
+
+		// Builds a program from opcode candidates, invalid or unsupported candidates are skipped. Returns the number of ops
+		uint32_t build(const std::vector<std::pair<TWord, TWord>>& _candidates)
+		{
+			m_program.clear();
+
+			for (const auto& c : _candidates)
+			{
+				if(m_program.size() >= g_maxOps)
+					break;
+
+				TWord opA = c.first & 0xffffff;
+				TWord opB = c.second & 0xffffff;
+
+				if(Opcodes::isParallelOpcode(opA))
+				{
+					const auto* oiMove = m_opcodes.findParallelMoveOpcodeInfo(opA);
+					const auto* oiAlu = m_opcodes.findParallelAluOpcodeInfo(opA);
+
+					if(!oiMove || !oiAlu || !isSupported(*oiMove) || !isSupported(*oiAlu))
+						continue;
+				}
+				else
+				{
+					const auto* oi = m_opcodes.findNonParallelOpcodeInfo(opA);
+
+					if(!oi || !isSupported(*oi))
+						continue;
+
+					// immediate data may be anything, other extension words are addresses
+					if(oi->m_extensionWordType != ImmediateData)
+						opB %= g_addressRange;
+				}
+
+				if(Opcodes::isParallelOpcode(opA))
+					opB %= g_addressRange;
+
+				std::string disasm;
+				const auto len = m_disasm.disassemble(disasm, opA, opB, 0, 0, 0);
+
+				if(len < 1 || len > 2)
+					continue;
+
+				m_program.push_back({opA, opB, static_cast<TWord>(len)});
+			}
+
+			return static_cast<uint32_t>(m_program.size());
+		}
+
+		// runs the current program with the given initial state. Returns false if the engines diverged
+		bool run(std::mt19937& _rand)
+		{
+			std::vector<TWord> p(g_dataSize, 0);
+
+			TWord pc = g_programStart;
+
+			for (const auto& op : m_program)
+			{
+				p[pc++] = op.opA;
+				if(op.len > 1)
+					p[pc++] = op.opB;
+			}
+
+			const TWord end = pc;
+
+			// jmp end, stays there
+			p[pc++] = 0x0c0000 | end;
+
+			std::vector<TWord> x(g_dataSize), y(g_dataSize);
+
+			for(TWord i=0; i<g_dataSize; ++i)
+			{
+				x[i] = _rand() & 0xffffff;
+				y[i] = _rand() & 0xffffff;
+			}
+
+			std::array<uint64_t, 16> regs;
+			for (auto& r : regs)
+				r = (static_cast<uint64_t>(_rand()) << 32) | _rand();
+
+			const uint32_t ccr = _rand() & 0xff;
+
+			for (auto* instance : {&m_jit, &m_interpreter})
+			{
+				auto& dsp = instance->dsp;
+				auto& mem = instance->mem;
+
+				mem.restore(MemArea_P, 0, p.data(), g_dataSize);
+				mem.restore(MemArea_X, 0, x.data(), g_dataSize);
+				mem.restore(MemArea_Y, 0, y.data(), g_dataSize);
+
+				dsp.resetHW();
+
+				auto& r = dsp.regs();
+
+				r.x.var = static_cast<int64_t>(regs[0] & 0xffffffffffff);
+				r.y.var = static_cast<int64_t>(regs[1] & 0xffffffffffff);
+				r.a.var = static_cast<int64_t>(regs[2] & 0xffffffffffffff);
+				r.b.var = static_cast<int64_t>(regs[3] & 0xffffffffffffff);
+
+				for(size_t i=0; i<8; ++i)
+				{
+					r.r[i].var = static_cast<int32_t>(regs[4 + i] % g_addressRange);
+					r.n[i].var = static_cast<int32_t>((regs[4 + i] >> 32) & 0xf);
+				}
+
+				r.sr.var = (r.sr.var & ~0xff) | ccr;
+
+				dsp.setPC(g_programStart);
+			}
+
+			execute(m_jit, end);
+			execute(m_interpreter, end);
+
+			return compare();
+		}
+
+		void printProgram() const
+		{
+			TWord pc = g_programStart;
+
+			for (const auto& op : m_program)
+			{
+				std::string disasm;
+				m_disasm.disassemble(disasm, op.opA, op.opB, 0, 0, pc);
+				std::cout << "  p:$" << hex(pc) << ' ' << hex(op.opA) << ' ' << (op.len > 1 ? hex(op.opB) : std::string("      ")) << " = " << disasm << std::endl;
+				pc += op.len;
+			}
+		}
+
+		bool ignoreCCR = false;
+
+	private:
+		struct Op
+		{
+			TWord opA;
+			TWord opB;
+			TWord len;
+		};
+
+		static void execute(Instance& _instance, const TWord _end)
+		{
+			auto& dsp = _instance.dsp;
+
+			for(uint32_t i=0; i<g_maxOps * 4 && dsp.getPC().var != _end; ++i)
+				dsp.exec();
+		}
+
+		bool compare() const
+		{
+			bool equal = true;
+
+			if(m_jit.dsp.getPC().var != m_interpreter.dsp.getPC().var)
+			{
+				std::cout << "  pc\tinterpreter " << hex(m_interpreter.dsp.getPC().var) << " jit " << hex(m_jit.dsp.getPC().var) << std::endl;
+				equal = false;
+			}
+
+			TraceRegs regsJit, regsInterpreter;
+			TraceRecorder::readRegs(regsJit, m_jit.dsp);
+			TraceRecorder::readRegs(regsInterpreter, m_interpreter.dsp);
+
+			if(ignoreCCR)
+			{
+				regsJit[static_cast<size_t>(TraceReg::SR)] &= ~0xff;
+				regsInterpreter[static_cast<size_t>(TraceReg::SR)] &= ~0xff;
+			}
+
+			for(size_t i=0; i<regsJit.size(); ++i)
+			{
+				if(regsJit[i] == regsInterpreter[i])
+					continue;
+
+				std::cout << "  " << getTraceRegName(static_cast<TraceReg>(i)) << "\tinterpreter " << hex(regsInterpreter[i], 14) << " jit " << hex(regsJit[i], 14) << std::endl;
+				equal = false;
+			}
+
+			for(uint32_t a=0; a<MemArea_COUNT; ++a)
+			{
+				const auto area = static_cast<EMemArea>(a);
+
+				for(TWord i=0; i<g_dataSize; ++i)
+				{
+					const auto vJit = m_jit.mem.get(area, i);
+					const auto vInterpreter = m_interpreter.mem.get(area, i);
+
+					if(vJit == vInterpreter)
+						continue;
+
+					std::cout << "  " << g_memAreaNames[area] << ":" << hex(i) << "\tinterpreter " << hex(vInterpreter) << " jit " << hex(vJit) << std::endl;
+					equal = false;
+				}
+			}
+
+			return equal;
+		}
+
+		Instance m_jit;
+		Instance m_interpreter;
+
+		Opcodes m_opcodes;
+		mutable Disassembler m_disasm{m_opcodes};
+
+		std::vector<Op> m_program;
+	};
+
+	Fuzzer& getFuzzer()
+	{
+		static std::unique_ptr<Fuzzer> fuzzer(new Fuzzer());
+		return *fuzzer;
+	}
+
+	// creates an opcode candidate by filling the variable bits of a random entry of g_opcodes
+	std::pair<TWord, TWord> randomOpcode(std::mt19937& _rand)
+	{
+		const auto& oi = g_opcodes[_rand() % std::size(g_opcodes)];
+
+		const TWord fixed = oi.m_mask0 | oi.m_mask1;
+		const TWord opA = (_rand() & ~fixed & 0xffffff) | oi.m_mask1;
+
+		return {opA, static_cast<TWord>(_rand() & 0xffffff)};
+	}
+}
+
+#ifdef DSP56K_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* _data, const size_t _size)
+{
+	if(_size < 4)
+		return 0;
+
+	uint32_t seed;
+	memcpy(&seed, _data, sizeof(seed));
+
+	std::vector<std::pair<TWord, TWord>> candidates;
+
+	for(size_t i=4; i + 6 <= _size; i += 6)
+	{
+		const TWord opA = _data[i] | (_data[i+1] << 8) | (_data[i+2] << 16);
+		const TWord opB = _data[i+3] | (_data[i+4] << 8) | (_data[i+5] << 16);
+		candidates.emplace_back(opA, opB);
+	}
+
+	auto& fuzzer = getFuzzer();
+
+	if(!fuzzer.build(candidates))
+		return 0;
+
+	std::mt19937 rand(seed);
+
+	if(!fuzzer.run(rand))
+	{
+		fuzzer.printProgram();
+		abort();
+	}
+
+	return 0;
+}
+
+#else
+
+int main(int _argc, char* _argv[])
+{
+	const CommandLine cmd(_argc, _argv);
+
+	if(cmd.contains("help"))
+	{
+		std::cout << "DSP 56300 JIT/Interpreter differential fuzzer" << std::endl;
+		std::cout << std::endl;
+		std::cout << "fuzzer [-iterations count] [-seed value] [-ops count] [-ignoreccr]" << std::endl;
+		std::cout << std::endl;
+		std::cout << "-iterations count  Number of programs to run. Default 10000" << std::endl;
+		std::cout << "-seed value        Random seed. Default 1" << std::endl;
+		std::cout << "-ops count         Number of instructions per program, 1-" << g_maxOps << ". Default 8" << std::endl;
+		std::cout << "-ignoreccr         Do not compare the condition code register" << std::endl;
+		return 0;
+	}
+
+	const auto iterations = std::stoul(cmd.tryGet("iterations", "10000"));
+	const auto seed = static_cast<uint32_t>(std::stoul(cmd.tryGet("seed", "1")));
+	const auto ops = std::min(std::max(std::stoul(cmd.tryGet("ops", "8")), 1ul), static_cast<unsigned long>(g_maxOps));
+
+	auto& fuzzer = getFuzzer();
+	fuzzer.ignoreCCR = cmd.contains("ignoreccr");
+
+	std::mt19937 rand(seed);
+
+	uint32_t failures = 0;
+
+	for(unsigned long i=0; i<iterations; ++i)
+	{
+		std::vector<std::pair<TWord, TWord>> candidates;
+
+		while(fuzzer.build(candidates) < ops)
+			candidates.push_back(randomOpcode(rand));
+
+		if(fuzzer.run(rand))
+			continue;
+
+		std::cout << "Iteration " << i << " diverged, program:" << std::endl;
+		fuzzer.printProgram();
+
+		if(++failures >= 10)
+			break;
+	}
+
+	std::cout << (iterations) << " iterations, " << failures << " divergences" << std::endl;
+
+	return failures ? 1 : 0;
+}
+
+#endif
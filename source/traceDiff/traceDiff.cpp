@@ -0,0 +1,348 @@
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include "../disassemble/commandline.h"
+
+#include "dsp56kEmu/disasm.h"
+#include "dsp56kEmu/dsp.h"
+#include "dsp56kEmu/memory.h"
+#include "dsp56kEmu/peripherals.h"
+#include "dsp56kEmu/snapshot.h"
+#include "dsp56kEmu/tracerecorder.h"
+
+using namespace dsp56k;
+
+namespace
+{
+	// if the interpreter does not reach the end of a JIT block within this number of instructions, execution diverged
+	constexpr uint32_t g_maxInterpreterSteps = 0x100000;
+
+	DefaultMemoryValidator g_memoryMap;
+
+	struct Instance
+	{
+		Instance(const TWord _memSize, const bool _interpreterOnly) : mem(g_memoryMap, _memSize), dsp(mem, &peripherals, &peripherals)
+		{
+			dsp.setInterpreterOnly(_interpreterOnly);
+		}
+
+		Peripherals56362 peripherals;
+		Memory mem;
+		DSP dsp;
+		Snapshot checkpoint;
+	};
+
+	std::string hex(const uint64_t _value, const int _digits = 6)
+	{
+		char temp[32];
+		snprintf(temp, sizeof(temp), "%0*llx", _digits, static_cast<unsigned long long>(_value));
+		return temp;
+	}
+
+	class TraceDiff
+	{
+	public:
+		TraceDiff(const TWord _memSize, const uint64_t _checkpointInterval) : m_jit(_memSize, false), m_interpreter(_memSize, true), m_checkpointInterval(_checkpointInterval)
+		{
+			Peripherals56362 p;
+			p.setSymbols(m_disasm);
+		}
+
+		bool load(const std::string& _filename, const TWord _pc)
+		{
+			if(!m_jit.mem.loadOMF(_filename) || !m_interpreter.mem.loadOMF(_filename))
+				return false;
+
+			m_jit.dsp.setPC(_pc);
+			m_interpreter.dsp.setPC(_pc);
+			return true;
+		}
+
+		// returns true if no divergence has been found
+		bool run(const uint64_t _maxInstructions)
+		{
+			createCheckpoint();
+
+			uint64_t instructions = 0;
+
+			while(instructions < _maxInstructions)
+			{
+				if(m_blocksSinceCheckpoint >= m_checkpointInterval)
+				{
+					if(!compareMemory())
+						return reportMemoryDivergence();
+
+					createCheckpoint();
+				}
+
+				const auto counter = m_jit.dsp.getInstructionCounter();
+
+				const bool equal = execBlock();
+
+				instructions += m_jit.dsp.getInstructionCounter() - counter;
+
+				if(!equal)
+				{
+					std::cout << "Registers diverged in block " << (m_blocksAtCheckpoint + m_blocksSinceCheckpoint) << std::endl;
+					reportBlock(m_blocksSinceCheckpoint);
+					return false;
+				}
+
+				++m_blocksSinceCheckpoint;
+			}
+
+			if(!compareMemory())
+				return reportMemoryDivergence();
+
+			std::cout << "No divergence found after " << (m_blocksAtCheckpoint + m_blocksSinceCheckpoint) << " blocks" << std::endl;
+			return true;
+		}
+
+	private:
+		// executes one JIT block and lets the interpreter catch up. Returns false if registers differ afterwards
+		bool execBlock()
+		{
+			m_jit.dsp.exec();
+
+			const TWord target = m_jit.dsp.getPC().var;
+
+			uint32_t steps = 0;
+
+			do
+			{
+				m_interpreter.dsp.exec();
+			}
+			while(m_interpreter.dsp.getPC().var != target && ++steps < g_maxInterpreterSteps);
+
+			return compareRegisters(false);
+		}
+
+		bool compareRegisters(const bool _print) const
+		{
+			TraceRegs regsJit, regsInterpreter;
+			TraceRecorder::readRegs(regsJit, m_jit.dsp);
+			TraceRecorder::readRegs(regsInterpreter, m_interpreter.dsp);
+
+			bool equal = m_jit.dsp.getPC().var == m_interpreter.dsp.getPC().var;
+
+			if(_print && !equal)
+				std::cout << "  pc   interpreter " << hex(m_interpreter.dsp.getPC().var) << " jit " << hex(m_jit.dsp.getPC().var) << std::endl;
+
+			for(size_t i=0; i<regsJit.size(); ++i)
+			{
+				if(regsJit[i] == regsInterpreter[i])
+					continue;
+
+				equal = false;
+
+				if(_print)
+					std::cout << "  " << getTraceRegName(static_cast<TraceReg>(i)) << "\tinterpreter " << hex(regsInterpreter[i], 14) << " jit " << hex(regsJit[i], 14) << std::endl;
+			}
+
+			return equal;
+		}
+
+		bool compareMemory(const bool _print = false) const
+		{
+			for(uint32_t a=0; a<MemArea_COUNT; ++a)
+			{
+				const auto area = static_cast<EMemArea>(a);
+				const auto size = m_jit.mem.size(area);
+				const auto* memJit = m_jit.mem.getMemAreaPtr(area);
+				const auto* memInterpreter = m_interpreter.mem.getMemAreaPtr(area);
+
+				if(!memcmp(memJit, memInterpreter, size * sizeof(TWord)))
+					continue;
+
+				if(_print)
+				{
+					for(TWord i=0; i<size; ++i)
+					{
+						if(memJit[i] != memInterpreter[i])
+							std::cout << "  " << g_memAreaNames[area] << ":" << hex(i) << "\tinterpreter " << hex(memInterpreter[i]) << " jit " << hex(memJit[i]) << std::endl;
+					}
+				}
+				return false;
+			}
+			return true;
+		}
+
+		void createCheckpoint()
+		{
+			m_jit.checkpoint.create(m_jit.dsp);
+			m_interpreter.checkpoint.create(m_interpreter.dsp);
+
+			m_blocksAtCheckpoint += m_blocksSinceCheckpoint;
+			m_blocksSinceCheckpoint = 0;
+		}
+
+		// restores the last checkpoint and executes _blocks blocks
+		void replay(const uint64_t _blocks)
+		{
+			m_jit.checkpoint.restore(m_jit.dsp);
+			m_interpreter.checkpoint.restore(m_interpreter.dsp);
+
+			for(uint64_t i=0; i<_blocks; ++i)
+				execBlock();
+		}
+
+		bool reportMemoryDivergence()
+		{
+			// memory is only compared at checkpoints, bisect to find the block that caused it
+			uint64_t good = 0;
+			uint64_t bad = m_blocksSinceCheckpoint;
+
+			if(!bad)
+			{
+				std::cout << "Memory differs at the start of execution" << std::endl;
+				compareMemory(true);
+				return false;
+			}
+
+			while(bad - good > 1)
+			{
+				const auto mid = (good + bad) >> 1;
+				replay(mid);
+
+				if(compareMemory())
+					good = mid;
+				else
+					bad = mid;
+			}
+
+			std::cout << "Memory diverged in block " << (m_blocksAtCheckpoint + bad - 1) << std::endl;
+
+			reportBlock(bad - 1);
+
+			std::cout << "Memory differences:" << std::endl;
+			compareMemory(true);
+
+			return false;
+		}
+
+		// replays the block with the given index relative to the last checkpoint. The interpreter is single-stepped
+		void reportBlock(const uint64_t _block)
+		{
+			replay(_block);
+
+			const TWord pcBegin = m_jit.dsp.getPC().var;
+
+			m_jit.dsp.exec();
+
+			const TWord target = m_jit.dsp.getPC().var;
+
+			std::cout << "Block $" << hex(pcBegin) << ", exit to $" << hex(target) << std::endl;
+			std::cout << "Interpreter:" << std::endl;
+
+			TraceRegs regsBefore;
+			TraceRecorder::readRegs(regsBefore, m_interpreter.dsp);
+
+			uint32_t steps = 0;
+
+			do
+			{
+				const TWord pc = m_interpreter.dsp.getPC().var;
+
+				TWord opA, opB;
+				m_interpreter.mem.getOpcode(pc, opA, opB);
+
+				m_interpreter.dsp.exec();
+
+				std::string disasm;
+				m_disasm.disassemble(disasm, opA, opB, 0, 0, pc);
+
+				std::cout << "  p:$" << hex(pc) << ' ' << hex(opA) << " = " << disasm;
+
+				TraceRegs regs;
+				TraceRecorder::readRegs(regs, m_interpreter.dsp);
+
+				for(size_t i=0; i<regs.size(); ++i)
+				{
+					if(regs[i] != regsBefore[i])
+						std::cout << "  " << getTraceRegName(static_cast<TraceReg>(i)) << "=" << hex(regs[i], 0);
+				}
+
+				std::cout << std::endl;
+
+				regsBefore = regs;
+			}
+			while(m_interpreter.dsp.getPC().var != target && ++steps < g_maxInterpreterSteps);
+
+			if(steps == g_maxInterpreterSteps)
+				std::cout << "Interpreter did not reach $" << hex(target) << std::endl;
+
+			std::cout << "Register differences after the block:" << std::endl;
+			compareRegisters(true);
+		}
+
+		Instance m_jit;
+		Instance m_interpreter;
+
+		Opcodes m_opcodes;
+		Disassembler m_disasm{m_opcodes};
+
+		const uint64_t m_checkpointInterval;
+
+		uint64_t m_blocksAtCheckpoint = 0;
+		uint64_t m_blocksSinceCheckpoint = 0;
+	};
+}
+
+int main(int _argc, char* _argv[])
+{
+	try
+	{
+		const CommandLine cmd(_argc, _argv);
+
+		if (!cmd.contains("in"))
+		{
+			std::cout << "DSP 56300 Interpreter/JIT Trace Diff" << std::endl;
+			std::cout << std::endl;
+			std::cout << "Runs a program with the JIT and the interpreter in lockstep and reports the first JIT block after which the" << std::endl;
+			std::cout << "registers or memory differ, including an instruction-by-instruction interpreter trace of that block." << std::endl;
+			std::cout << std::endl;
+			std::cout << "Usage:" << std::endl;
+			std::cout << std::endl;
+			std::cout << "traceDiff -in inputfile [-pc address] [-instructions count] [-checkpoint blocks] [-memsize words]" << std::endl;
+			std::cout << std::endl;
+			std::cout << "Options:" << std::endl;
+			std::cout << "-in filename         Program in OMF (.lod) format, required." << std::endl;
+			std::cout << "-pc address          Start address, hexadecimal. Default 0" << std::endl;
+			std::cout << "-instructions count  Number of instructions to execute. Default 10000000" << std::endl;
+			std::cout << "-checkpoint blocks   Number of blocks between memory comparisons and checkpoints. Default 4096" << std::endl;
+			std::cout << "-memsize words       Memory size per area, hexadecimal. Default 100000" << std::endl;
+			std::cout << std::endl;
+			std::cout << "Both instances use their own peripherals. Peripherals are clocked differently by the JIT and the interpreter," << std::endl;
+			std::cout << "programs that depend on exact peripheral timing may diverge for that reason." << std::endl;
+			return -1;
+		}
+
+		const auto pc = static_cast<TWord>(std::stoul(cmd.tryGet("pc", "0"), nullptr, 16));
+		const auto instructions = std::stoull(cmd.tryGet("instructions", "10000000"));
+		const auto checkpoint = std::max<uint64_t>(1, std::stoull(cmd.tryGet("checkpoint", "4096")));
+		const auto memSize = static_cast<TWord>(std::stoul(cmd.tryGet("memsize", "100000"), nullptr, 16));
+
+		std::unique_ptr<TraceDiff> diff(new TraceDiff(memSize, checkpoint));
+
+		const auto inFile = cmd.get("in");
+
+		if(!diff->load(inFile, pc))
+		{
+			std::cout << "Failed to load input file " << inFile << std::endl;
+			return -1;
+		}
+
+		return diff->run(instructions) ? 0 : 1;
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cout << "Fatal error: " << e.what();
+		return -1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << "Fatal error: " << e.what();
+		return -1;
+	}
+}